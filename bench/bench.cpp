@@ -0,0 +1,427 @@
+// vocoder-bench: microbenchmarks for the DSP and UI hot paths.
+// Reports ns per call, samples per second and heap allocations per call.
+//
+//   vocoder-bench [filter]   run only benchmarks whose name contains filter
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+#include "audio/drift.h"
+#include "dsp/fft.h"
+#include "dsp/multichannel.h"
+#include "dsp/pitchshift.h"
+#include "dsp/wsola.h"
+#include "dsp/simd.h"
+#include "dsp/utils.h"
+#include "ui/tui.h"
+#include "config.h"
+
+namespace {
+    std::atomic<size_t> g_allocations{0};
+}
+
+// The replacements below pair malloc/free consistently; GCC cannot see that
+// through the inlined new/delete expressions.
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+    constexpr double MIN_SECONDS = 0.2;
+
+    struct Result {
+        double ns_per_call;
+        double samples_per_sec;
+        double allocs_per_call;
+    };
+
+    const char* g_filter = nullptr;
+
+    // Runs fn until MIN_SECONDS have elapsed (after one warm-up call).
+    // samples_per_call is the number of audio samples one call consumes.
+    void bench(const std::string& name, size_t samples_per_call, const std::function<void()>& fn) {
+        if (g_filter && name.find(g_filter) == std::string::npos) return;
+
+        using clock = std::chrono::steady_clock;
+        fn();
+
+        size_t iterations = 1;
+        double elapsed = 0.0;
+        size_t allocs = 0;
+        for (;;) {
+            size_t allocs_before = g_allocations.load(std::memory_order_relaxed);
+            auto start = clock::now();
+            for (size_t i = 0; i < iterations; i++) {
+                fn();
+            }
+            elapsed = std::chrono::duration<double>(clock::now() - start).count();
+            allocs = g_allocations.load(std::memory_order_relaxed) - allocs_before;
+            if (elapsed >= MIN_SECONDS) break;
+            iterations *= (elapsed > 0.0) ? std::max<size_t>(2, static_cast<size_t>(MIN_SECONDS / elapsed * 1.2)) : 10;
+        }
+
+        Result r;
+        r.ns_per_call = elapsed * 1e9 / iterations;
+        r.samples_per_sec = samples_per_call * iterations / elapsed;
+        r.allocs_per_call = static_cast<double>(allocs) / iterations;
+
+        if (samples_per_call > 0) {
+            std::printf("%-36s %12.1f %14.3e %12.2f\n", name.c_str(),
+                        r.ns_per_call, r.samples_per_sec, r.allocs_per_call);
+        } else {
+            std::printf("%-36s %12.1f %14s %12.2f\n", name.c_str(),
+                        r.ns_per_call, "-", r.allocs_per_call);
+        }
+    }
+
+    std::vector<float> make_signal(size_t n) {
+        std::vector<float> signal(n);
+        for (size_t i = 0; i < n; i++) {
+            signal[i] = 0.5f * std::sin(2.0f * M_PI * 440.0f * i / SAMPLE_RATE) +
+                        0.1f * std::sin(2.0f * M_PI * 3150.0f * i / SAMPLE_RATE);
+        }
+        return signal;
+    }
+
+    // Checks every supported SIMD level against the scalar reference.
+    // Tolerances: products 1e-6 of full scale (FMA rounding), sums
+    // 1e-4 relative (summation order), dB values 1e-3 dB absolute.
+    bool verify_simd() {
+        const size_t n = 4099;  // odd length exercises the scalar tails
+        std::vector<float> a(2 * n), b(n), acc(n);
+        unsigned seed = 12345;
+        auto rnd = [&] {
+            seed = seed * 1103515245u + 12345u;
+            return static_cast<float>((seed >> 8) & 0xFFFF) / 32768.0f - 1.0f;
+        };
+        for (auto& v : a) v = rnd();
+        for (auto& v : b) v = rnd();
+        for (auto& v : acc) v = rnd();
+        // Magnitudes across the full dB range, including the epsilon floor
+        std::vector<float> mags(n);
+        for (size_t i = 0; i < n; i++) mags[i] = std::pow(10.0f, -12.0f + 13.0f * i / n);
+
+        simd::Level best = simd::detected_level();
+        simd::set_level(simd::Level::SCALAR);
+        std::vector<float> ref_mul(n), ref_mac(acc), ref_scale(n), ref_mag(n), ref_db(n);
+        simd::multiply(a.data(), b.data(), ref_mul.data(), n);
+        simd::multiply_add(a.data(), b.data(), ref_mac.data(), n);
+        simd::scale(a.data(), 0.7f, ref_scale.data(), n);
+        std::vector<float> ref_ramp(n);
+        simd::scale_ramp(a.data(), 1.0f, -1.0f / n, ref_ramp.data(), n);
+        float ref_sum = simd::sum_squares(a.data(), n);
+        simd::magnitude(a.data(), ref_mag.data(), n);
+        simd::magnitude_to_db(mags.data(), ref_db.data(), n, -200.0f, 20.0f);
+        // Device sample conversions, past full scale to exercise saturation
+        std::vector<float> loud(n);
+        simd::scale(a.data(), 1.25f, loud.data(), n);
+        std::vector<int16_t> ref_s16(n);
+        std::vector<int32_t> ref_s24(n), ref_s32(n);
+        std::vector<float> ref_from16(n), ref_from24(n), ref_from32(n);
+        simd::float_to_s16(loud.data(), ref_s16.data(), n);
+        simd::float_to_s32(loud.data(), ref_s24.data(), n, 24);
+        simd::float_to_s32(loud.data(), ref_s32.data(), n, 32);
+        simd::s16_to_float(ref_s16.data(), ref_from16.data(), n);
+        simd::s32_to_float(ref_s24.data(), ref_from24.data(), n, 24);
+        simd::s32_to_float(ref_s32.data(), ref_from32.data(), n, 32);
+
+        // Error relative to the largest reference value (FMA changes the
+        // rounding of results that cancel to near zero)
+        auto max_rel = [](const std::vector<float>& x, const std::vector<float>& ref) {
+            double scale = 1e-30;
+            double worst = 0.0;
+            for (size_t i = 0; i < x.size(); i++) {
+                scale = std::max(scale, std::fabs(static_cast<double>(ref[i])));
+                worst = std::max(worst, std::fabs(static_cast<double>(x[i]) - ref[i]));
+            }
+            return worst / scale;
+        };
+
+        bool ok = true;
+        for (int l = static_cast<int>(simd::Level::SSE2); l <= static_cast<int>(best); l++) {
+            simd::Level level = static_cast<simd::Level>(l);
+            simd::set_level(level);
+
+            std::vector<float> mul(n), mac(acc), scaled(n), mag(n), db(n);
+            simd::multiply(a.data(), b.data(), mul.data(), n);
+            simd::multiply_add(a.data(), b.data(), mac.data(), n);
+            simd::scale(a.data(), 0.7f, scaled.data(), n);
+            std::vector<float> ramp(n);
+            simd::scale_ramp(a.data(), 1.0f, -1.0f / n, ramp.data(), n);
+            float sum = simd::sum_squares(a.data(), n);
+            simd::magnitude(a.data(), mag.data(), n);
+            simd::magnitude_to_db(mags.data(), db.data(), n, -200.0f, 20.0f);
+
+            // Stereo (de)interleave must be exact
+            std::vector<float> left(n), right(n), merged(2 * n);
+            float* planes[2] = {left.data(), right.data()};
+            const float* const_planes[2] = {left.data(), right.data()};
+            simd::deinterleave(a.data(), planes, 2, n);
+            simd::interleave(const_planes, merged.data(), 2, n);
+            bool interleave_ok = merged == a && left[n - 1] == a[2 * n - 2] && right[0] == a[1];
+
+            // Sample conversions must be exact too
+            std::vector<int16_t> s16(n);
+            std::vector<int32_t> s24(n), s32(n);
+            std::vector<float> from16(n), from24(n), from32(n);
+            simd::float_to_s16(loud.data(), s16.data(), n);
+            simd::float_to_s32(loud.data(), s24.data(), n, 24);
+            simd::float_to_s32(loud.data(), s32.data(), n, 32);
+            simd::s16_to_float(s16.data(), from16.data(), n);
+            simd::s32_to_float(s24.data(), from24.data(), n, 24);
+            simd::s32_to_float(s32.data(), from32.data(), n, 32);
+            bool convert_ok = s16 == ref_s16 && s24 == ref_s24 && s32 == ref_s32 &&
+                              from16 == ref_from16 && from24 == ref_from24 && from32 == ref_from32;
+
+            double err_db = 0.0;
+            for (size_t i = 0; i < n; i++) {
+                err_db = std::max(err_db, std::fabs(static_cast<double>(db[i]) - ref_db[i]));
+            }
+            double err_prod = std::max({max_rel(mul, ref_mul), max_rel(mac, ref_mac),
+                                        max_rel(scaled, ref_scale), max_rel(ramp, ref_ramp),
+                                        max_rel(mag, ref_mag)});
+            double err_sum = std::fabs(sum - ref_sum) / ref_sum;
+            bool pass = err_prod <= 1e-6 && err_sum <= 1e-4 && err_db <= 1e-3 && interleave_ok && convert_ok;
+            ok = ok && pass;
+
+            std::printf("simd %-7s vs scalar: products %.1e, sum %.1e, dB %.1e  %s\n",
+                        simd::level_name(level), err_prod, err_sum, err_db, pass ? "ok" : "FAIL");
+        }
+
+        simd::set_level(best);
+        return ok;
+    }
+
+    // An hour of capture at +100 ppm into playback at -50 ppm, with
+    // measurement jitter of up to 64 frames. Once settled (after ten
+    // minutes) the true delay must stay within 2 frames of the target.
+    bool verify_drift() {
+        const size_t block = BUFFER_FRAMES;
+        const double capture_rate = SAMPLE_RATE * (1.0 + 100e-6);
+        const double playback_rate = SAMPLE_RATE * (1.0 - 50e-6);
+        const double jitter_mean = 31.5;
+
+        DriftCompensator drift(1, block);
+        std::vector<float> input = make_signal(block);
+        std::vector<float> output(drift.max_output(block));
+        double delay = 2.0 * block;  // frames queued for playback
+        double worst = 0.0;
+        bool underrun = false;
+        for (long n = 0; n * block < 3600.0 * capture_rate; n++) {
+            delay -= playback_rate * block / capture_rate;
+            if (delay < 0.0) {
+                underrun = true;
+                break;
+            }
+            double jitter = std::fmod(n * 37.0, 64.0);
+            drift.update(static_cast<long>(delay + jitter), block);
+            if (n * block > 600.0 * capture_rate) {
+                worst = std::max(worst, std::fabs(delay + jitter_mean - drift.target()));
+            }
+            delay += static_cast<double>(drift.process(input.data(), block, output.data()));
+        }
+
+        bool pass = !underrun && worst <= 2.0;
+        std::printf("drift 1 h at +100/-50 ppm: delay within %.2f frames of target, correction %.1f ppm  %s\n",
+                    worst, drift.ppm(), pass ? "ok" : "FAIL");
+        return pass;
+    }
+
+    void bench_fft() {
+        for (size_t size : {512, 1024, 2048, 4096, 8192, 16384}) {
+            FFTProcessor fft(size);
+            std::vector<float> input = make_signal(size);
+            std::vector<float> real(size / 2 + 1);
+            std::vector<float> imag(size / 2 + 1);
+            std::vector<float> output(size);
+
+            bench("fft.forward/" + std::to_string(size), size, [&] {
+                fft.forward(input.data(), real.data(), imag.data());
+            });
+            bench("fft.inverse/" + std::to_string(size), size, [&] {
+                fft.inverse(real.data(), imag.data(), output.data());
+            });
+
+            std::copy(input.begin(), input.end(), fft.time_buffer());
+            bench("fft.execute_forward/" + std::to_string(size), size, [&] {
+                fft.execute_forward();
+            });
+            bench("fft.execute_inverse/" + std::to_string(size), size, [&] {
+                fft.execute_inverse();
+            });
+        }
+    }
+
+    void bench_pitchshift() {
+        const size_t configs[][2] = {
+            {1024, 256}, {2048, 512}, {4096, 1024}, {4096, 512}, {8192, 2048}, {8192, 1024},
+            {3072, 768}, {6144, 1536}
+        };
+        std::vector<float> input = make_signal(BUFFER_FRAMES);
+        std::vector<float> output(BUFFER_FRAMES);
+
+        for (const auto& config : configs) {
+            PitchShifter shifter(config[0], config[1], SAMPLE_RATE);
+            shifter.set_pitch_ratio(1.5f);
+            bench("pitchshift.process/" + std::to_string(config[0]) + "/" + std::to_string(config[1]) +
+                  (PitchShifter::has_fixed_kernel(config[0]) ? "" : "/generic"),
+                  BUFFER_FRAMES, [&] {
+                shifter.process(input.data(), output.data(), BUFFER_FRAMES);
+            });
+        }
+
+        // Playback resampling for unlinked devices, stereo
+        {
+            std::vector<float> interleaved(BUFFER_FRAMES * 2);
+            for (size_t i = 0; i < interleaved.size(); i++) interleaved[i] = input[i / 2];
+            DriftCompensator drift(2, BUFFER_FRAMES);
+            std::vector<float> resampled(drift.max_output(BUFFER_FRAMES) * 2);
+            bench("drift.process/2ch", BUFFER_FRAMES * 2, [&] {
+                drift.process(interleaved.data(), BUFFER_FRAMES, resampled.data());
+            });
+        }
+
+        // Wall time per block; the synthesis half runs on a second core
+        for (size_t fft_size : {4096, 8192}) {
+            PitchShifter shifter(fft_size, fft_size / 4, SAMPLE_RATE);
+            shifter.set_pitch_ratio(1.5f);
+            shifter.set_pipelined(true);
+            bench("pitchshift.process/" + std::to_string(fft_size) + "/" + std::to_string(fft_size / 4) +
+                  "/pipelined", BUFFER_FRAMES, [&] {
+                shifter.process(input.data(), output.data(), BUFFER_FRAMES);
+            });
+        }
+
+        for (size_t channels : {2, 4}) {
+            std::vector<float> interleaved(BUFFER_FRAMES * channels);
+            std::vector<float> interleaved_out(BUFFER_FRAMES * channels);
+            for (size_t i = 0; i < interleaved.size(); i++) interleaved[i] = input[i / channels];
+            MultiChannelShifter multi(channels, FFT_SIZE, HOP_SIZE, SAMPLE_RATE);
+            multi.set_pitch_ratio(1.5f);
+            bench("multichannel.process/" + std::to_string(channels) + "ch" +
+                  (multi.parallel() ? "/parallel" : "/serial"),
+                  BUFFER_FRAMES * channels, [&] {
+                multi.process(interleaved.data(), interleaved_out.data(), BUFFER_FRAMES);
+            });
+        }
+
+        for (float ratio : {0.75f, 1.5f}) {
+            WsolaShifter wsola(FFT_SIZE);
+            wsola.set_pitch_ratio(ratio);
+            char name[48];
+            std::snprintf(name, sizeof(name), "wsola.process/%.2f", ratio);
+            bench(name, BUFFER_FRAMES, [&] {
+                wsola.process(input.data(), output.data(), BUFFER_FRAMES);
+            });
+        }
+
+        PitchShifter shifter(FFT_SIZE, HOP_SIZE, SAMPLE_RATE);
+        shifter.process(input.data(), output.data(), BUFFER_FRAMES);
+        SpectrumBands bands(FFT_SIZE, SAMPLE_RATE);
+        std::vector<float> spectrum(bands.bands());
+        bench("pitchshift.get_spectrum/" + std::to_string(bands.bands()) + "bands", FFT_SIZE / 2 + 1, [&] {
+            shifter.get_spectrum(bands, spectrum.data());
+        });
+    }
+
+    void bench_utils() {
+        std::vector<float> input = make_signal(BUFFER_FRAMES);
+        volatile float sink = 0.0f;
+        bench("calculate_db/" + std::to_string(BUFFER_FRAMES), BUFFER_FRAMES, [&] {
+            sink = calculate_db(input.data(), BUFFER_FRAMES);
+        });
+        (void)sink;
+
+        // Stereo blocks as ALSA hands them over
+        const size_t samples = BUFFER_FRAMES * 2;
+        std::vector<float> samples_in = make_signal(samples);
+        std::vector<float> samples_out(samples);
+        std::vector<int16_t> s16(samples);
+        std::vector<int32_t> s32(samples);
+        bench("convert.float_to_s16/" + std::to_string(samples), samples, [&] {
+            simd::float_to_s16(samples_in.data(), s16.data(), samples);
+        });
+        bench("convert.s16_to_float/" + std::to_string(samples), samples, [&] {
+            simd::s16_to_float(s16.data(), samples_out.data(), samples);
+        });
+        bench("convert.float_to_s24/" + std::to_string(samples), samples, [&] {
+            simd::float_to_s32(samples_in.data(), s32.data(), samples, 24);
+        });
+        bench("convert.s24_to_float/" + std::to_string(samples), samples, [&] {
+            simd::s32_to_float(s32.data(), samples_out.data(), samples, 24);
+        });
+    }
+
+    void bench_tui() {
+        if (g_filter && std::string("tui.render").find(g_filter) == std::string::npos) return;
+
+        FILE* out = std::fopen("/dev/null", "w");
+        FILE* in = std::fopen("/dev/null", "r");
+        if (!out || !in) return;
+
+        {
+            TUI ui;
+            ui.init("xterm-256color", out, in);
+
+            PitchShifter shifter(FFT_SIZE, HOP_SIZE, SAMPLE_RATE);
+            std::vector<float> input = make_signal(FFT_SIZE);
+            std::vector<float> output(FFT_SIZE);
+            shifter.process(input.data(), output.data(), FFT_SIZE);
+
+            AudioStats stats{};
+            stats.input_level = -12.0f;
+            stats.output_level = -6.0f;
+            stats.pitch_ratio = 1.0f;
+            stats.volume = 0.8f;
+            SpectrumBands bands(FFT_SIZE, SAMPLE_RATE);
+            stats.spectrum.resize(bands.bands());
+            shifter.get_spectrum(bands, stats.spectrum.data());
+
+            bench("tui.render", 0, [&] {
+                ui.render(stats);
+            });
+        }
+
+        std::fclose(out);
+        std::fclose(in);
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) {
+        g_filter = argv[1];
+    }
+
+    bool simd_ok = verify_simd();
+    bool drift_ok = verify_drift();
+    std::printf("simd level: %s\n", simd::level_name(simd::active_level()));
+    std::printf("block budget: %d frames @ %d Hz = %.2f ms\n\n",
+                BUFFER_FRAMES, SAMPLE_RATE, 1000.0 * BUFFER_FRAMES / SAMPLE_RATE);
+    std::printf("%-36s %12s %14s %12s\n", "benchmark", "ns/call", "samples/s", "allocs/call");
+
+    bench_fft();
+    bench_pitchshift();
+    bench_utils();
+    bench_tui();
+    return simd_ok && drift_ok ? 0 : 1;
+}
@@ -1,9 +1,77 @@
 #include "audio/alsa.h"
+#include "dsp/simd.h"
 #include "utils/logger.h"
+#include "utils/trace.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
 #include <cstring>
+#include "config.h"
 
 namespace {
-    bool configure_pcm_params(snd_pcm_t* pcm, int sample_rate, int channels, snd_pcm_uframes_t& buffer_size) {
+    constexpr int MAX_RECOVERIES = 4;  // per playback() call before giving up on the block
+
+    // What SampleFormat::AUTO tries, in order: float needs no conversion,
+    // then the widest integer format the device has
+    const snd_pcm_format_t AUTO_FORMATS[] = {
+        SND_PCM_FORMAT_FLOAT, SND_PCM_FORMAT_S32, SND_PCM_FORMAT_S24, SND_PCM_FORMAT_S16
+    };
+
+    snd_pcm_format_t alsa_format(SampleFormat format) {
+        switch (format) {
+            case SampleFormat::FLOAT: return SND_PCM_FORMAT_FLOAT;
+            case SampleFormat::S32:   return SND_PCM_FORMAT_S32;
+            case SampleFormat::S24:   return SND_PCM_FORMAT_S24;
+            case SampleFormat::S16:   return SND_PCM_FORMAT_S16;
+            case SampleFormat::AUTO:
+            default:                  return SND_PCM_FORMAT_UNKNOWN;
+        }
+    }
+
+    size_t sample_bytes(snd_pcm_format_t format) {
+        return format == SND_PCM_FORMAT_S16 ? sizeof(int16_t) : sizeof(float);
+    }
+
+    // Device samples to interleaved floats, and back
+    void from_device(snd_pcm_format_t format, const void* in, float* out, size_t samples) {
+        switch (format) {
+            case SND_PCM_FORMAT_S16:
+                simd::s16_to_float(static_cast<const int16_t*>(in), out, samples);
+                break;
+            case SND_PCM_FORMAT_S24:
+                simd::s32_to_float(static_cast<const int32_t*>(in), out, samples, 24);
+                break;
+            case SND_PCM_FORMAT_S32:
+                simd::s32_to_float(static_cast<const int32_t*>(in), out, samples, 32);
+                break;
+            default:
+                std::memcpy(out, in, samples * sizeof(float));
+                break;
+        }
+    }
+
+    void to_device(snd_pcm_format_t format, const float* in, void* out, size_t samples) {
+        switch (format) {
+            case SND_PCM_FORMAT_S16:
+                simd::float_to_s16(in, static_cast<int16_t*>(out), samples);
+                break;
+            case SND_PCM_FORMAT_S24:
+                simd::float_to_s32(in, static_cast<int32_t*>(out), samples, 24);
+                break;
+            case SND_PCM_FORMAT_S32:
+                simd::float_to_s32(in, static_cast<int32_t*>(out), samples, 32);
+                break;
+            default:
+                std::memcpy(out, in, samples * sizeof(float));
+                break;
+        }
+    }
+
+    // sample_rate and period_size/periods are requests (0 = driver default
+    // for the period) and come back as negotiated, as does format
+    bool configure_pcm_params(snd_pcm_t* pcm, int& sample_rate, int channels, SampleFormat requested,
+                              snd_pcm_format_t& format, snd_pcm_uframes_t& buffer_size,
+                              snd_pcm_uframes_t& period_size, unsigned int& periods, bool& mmap) {
         snd_pcm_hw_params_t* params;
         int err;
 
@@ -16,20 +84,35 @@ namespace {
             return false;
         }
 
-        err = snd_pcm_hw_params_set_access(pcm, params, SND_PCM_ACCESS_RW_INTERLEAVED);
+        // Prefer direct access to the device ring; plugins like pulse only do RW
+        mmap = snd_pcm_hw_params_set_access(pcm, params, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0;
+        err = mmap ? 0 : snd_pcm_hw_params_set_access(pcm, params, SND_PCM_ACCESS_RW_INTERLEAVED);
         if (err < 0) {
             LOG_ERROR(std::string("Cannot set access type: ") + snd_strerror(err));
             snd_pcm_hw_params_free(params);
             return false;
         }
 
-        err = snd_pcm_hw_params_set_format(pcm, params, SND_PCM_FORMAT_FLOAT);
+        format = alsa_format(requested);
+        if (requested == SampleFormat::AUTO) {
+            for (snd_pcm_format_t candidate : AUTO_FORMATS) {
+                if (snd_pcm_hw_params_test_format(pcm, params, candidate) == 0) {
+                    format = candidate;
+                    break;
+                }
+            }
+        }
+        err = format == SND_PCM_FORMAT_UNKNOWN ? -EINVAL : snd_pcm_hw_params_set_format(pcm, params, format);
         if (err < 0) {
             LOG_ERROR(std::string("Cannot set sample format: ") + snd_strerror(err));
             snd_pcm_hw_params_free(params);
             return false;
         }
 
+        // Take the nearest rate the device runs at rather than letting the
+        // plug layer resample in the audio path
+        snd_pcm_hw_params_set_rate_resample(pcm, params, 0);
+
         unsigned int rate = sample_rate;
         err = snd_pcm_hw_params_set_rate_near(pcm, params, &rate, 0);
         if (err < 0) {
@@ -37,6 +120,10 @@ namespace {
             snd_pcm_hw_params_free(params);
             return false;
         }
+        if (static_cast<int>(rate) != sample_rate) {
+            LOG_INFOF("Sample rate %d Hz not supported, using %u Hz", sample_rate, rate);
+            sample_rate = static_cast<int>(rate);
+        }
 
         err = snd_pcm_hw_params_set_channels(pcm, params, channels);
         if (err < 0) {
@@ -45,6 +132,24 @@ namespace {
             return false;
         }
 
+        if (period_size > 0) {
+            err = snd_pcm_hw_params_set_period_size_near(pcm, params, &period_size, nullptr);
+            if (err < 0) {
+                LOG_ERROR(std::string("Cannot set period size: ") + snd_strerror(err));
+                snd_pcm_hw_params_free(params);
+                return false;
+            }
+        }
+
+        if (periods > 0) {
+            err = snd_pcm_hw_params_set_periods_near(pcm, params, &periods, nullptr);
+            if (err < 0) {
+                LOG_ERROR(std::string("Cannot set period count: ") + snd_strerror(err));
+                snd_pcm_hw_params_free(params);
+                return false;
+            }
+        }
+
         err = snd_pcm_hw_params(pcm, params);
         if (err < 0) {
             LOG_ERROR(std::string("Cannot set hardware parameters: ") + snd_strerror(err));
@@ -53,6 +158,8 @@ namespace {
         }
 
         snd_pcm_hw_params_get_buffer_size(params, &buffer_size);
+        snd_pcm_hw_params_get_period_size(params, &period_size, nullptr);
+        snd_pcm_hw_params_get_periods(params, &periods, nullptr);
         snd_pcm_hw_params_free(params);
 
         err = snd_pcm_prepare(pcm);
@@ -63,10 +170,62 @@ namespace {
 
         return true;
     }
+
+    // Copy between interleaved float frames and the device ring, converting
+    // the samples on the way. Returns the frames transferred or a negative
+    // error.
+    snd_pcm_sframes_t mmap_transfer(snd_pcm_t* pcm, snd_pcm_format_t format, float* read_to,
+                                    const float* write_from, size_t frames, int channels) {
+        const size_t frame_bytes = channels * sample_bytes(format);
+        size_t done = 0;
+        while (done < frames) {
+            const snd_pcm_channel_area_t* areas;
+            snd_pcm_uframes_t offset;
+            snd_pcm_uframes_t n = frames - done;
+            int err = snd_pcm_mmap_begin(pcm, &areas, &offset, &n);
+            if (err < 0) return err;
+            if (n == 0) break;
+
+            // Interleaved: channel 0's area steps over whole frames
+            uint8_t* ring = static_cast<uint8_t*>(areas[0].addr) + areas[0].first / 8 + offset * frame_bytes;
+            if (read_to) {
+                from_device(format, ring, read_to + done * channels, n * channels);
+            } else {
+                to_device(format, write_from + done * channels, ring, n * channels);
+            }
+
+            snd_pcm_sframes_t committed = snd_pcm_mmap_commit(pcm, offset, n);
+            if (committed < 0) return committed;
+            if (static_cast<snd_pcm_uframes_t>(committed) != n) return -EPIPE;
+            done += n;
+        }
+        return static_cast<snd_pcm_sframes_t>(done);
+    }
 }
 
-ALSADevice::ALSADevice() : pcm_capture_(nullptr), pcm_playback_(nullptr),
-    sample_rate_(44100), channels_(1), buffer_size_(1024) {
+ALSADevice::ALSADevice(int channels, snd_pcm_uframes_t period_size, unsigned int periods, int sample_rate,
+                       SampleFormat format)
+    : sample_rate_(sample_rate), channels_(channels),
+      period_size_(period_size), periods_(periods), buffer_size_(BUFFER_FRAMES),
+      requested_format_(format), linked_(false), drift_enabled_(true),
+      dropped_metric_(MetricsRegistry::instance().counter("vocoder_dropped_frames_total",
+                                                           "Output frames dropped after a playback stall")),
+      drift_metric_(MetricsRegistry::instance().gauge("vocoder_drift_ppm",
+                                                       "Playback resampling correction for clock drift")) {
+    MetricsRegistry& metrics = MetricsRegistry::instance();
+    capture_.xrun_metric = &metrics.counter("vocoder_xruns_total", "ALSA over- and underruns", "stream=\"capture\"");
+    playback_.xrun_metric = &metrics.counter("vocoder_xruns_total", "ALSA over- and underruns", "stream=\"playback\"");
+    capture_.recover_metric = &metrics.counter("vocoder_recoveries_total", "snd_pcm_recover calls", "stream=\"capture\"");
+    playback_.recover_metric = &metrics.counter("vocoder_recoveries_total", "snd_pcm_recover calls", "stream=\"playback\"");
+}
+
+std::string ALSADevice::describe(const Stream& stream, const char* name) const {
+    char text[160];
+    std::snprintf(text, sizeof(text), "%s: %s access, %s at %d Hz, %u x %lu frames (%.1f ms buffer)", name,
+                  stream.mmap ? "mmap" : "read/write", snd_pcm_format_name(stream.format), sample_rate_,
+                  stream.periods, static_cast<unsigned long>(stream.period),
+                  1000.0 * stream.period * stream.periods / sample_rate_);
+    return text;
 }
 
 ALSADevice::~ALSADevice() {
@@ -74,91 +233,302 @@ ALSADevice::~ALSADevice() {
 }
 
 bool ALSADevice::open_capture(const char* device_name) {
-    int err = snd_pcm_open(&pcm_capture_, device_name, SND_PCM_STREAM_CAPTURE, SND_PCM_NONBLOCK);
+    int err = snd_pcm_open(&capture_.pcm, device_name, SND_PCM_STREAM_CAPTURE, SND_PCM_NONBLOCK);
     if (err < 0) {
         LOG_ERROR(std::string("Cannot open capture device '") + device_name + "': " + snd_strerror(err));
+        capture_.pcm = nullptr;
         return false;
     }
 
-    return configure_pcm_params(pcm_capture_, sample_rate_, channels_, buffer_size_);
+    capture_.period = period_size_;
+    capture_.periods = periods_;
+    if (!configure_pcm_params(capture_.pcm, sample_rate_, channels_, requested_format_, capture_.format,
+                              buffer_size_, capture_.period, capture_.periods, capture_.mmap)) {
+        return false;
+    }
+    LOG_INFO(describe(capture_, "Capture"));
+    reserve_staging(capture_, buffer_size_);
+
+    setup_poll();
+    start_streams();
+    return true;
 }
 
 bool ALSADevice::open_playback(const char* device_name) {
-    int err = snd_pcm_open(&pcm_playback_, device_name, SND_PCM_STREAM_PLAYBACK, SND_PCM_NONBLOCK);
+    int err = snd_pcm_open(&playback_.pcm, device_name, SND_PCM_STREAM_PLAYBACK, SND_PCM_NONBLOCK);
     if (err < 0) {
         LOG_ERROR(std::string("Cannot open playback device '") + device_name + "': " + snd_strerror(err));
+        playback_.pcm = nullptr;
         return false;
     }
 
     snd_pcm_uframes_t playback_buffer_size;
-    if (!configure_pcm_params(pcm_playback_, sample_rate_, channels_, playback_buffer_size)) {
+    playback_.period = period_size_;
+    playback_.periods = periods_;
+    int capture_rate = sample_rate_;
+    if (!configure_pcm_params(playback_.pcm, sample_rate_, channels_, requested_format_, playback_.format,
+                              playback_buffer_size, playback_.period, playback_.periods, playback_.mmap)) {
         return false;
     }
-
-    err = snd_pcm_start(pcm_playback_);
-    if (err < 0) {
-        LOG_ERROR(std::string("Cannot start playback interface: ") + snd_strerror(err));
+    LOG_INFO(describe(playback_, "Playback"));
+    if (capture_.pcm && sample_rate_ != capture_rate) {
+        LOG_ERRORF("Playback runs at %d Hz but capture at %d Hz", sample_rate_, capture_rate);
         return false;
     }
+    reserve_staging(playback_, playback_buffer_size);
+    silence_.assign(std::max<size_t>(playback_.period, 1) * channels_, 0.0f);
 
-    return true;
+    // Restart the capture stream together with playback when they can be linked
+    if (capture_.pcm) {
+        snd_pcm_drop(capture_.pcm);
+        snd_pcm_prepare(capture_.pcm);
+        linked_ = snd_pcm_link(capture_.pcm, playback_.pcm) == 0;
+        LOG_INFO(std::string("Capture and playback ") + (linked_ ? "linked" : "not linked (separate clocks)"));
+        if (!linked_ && drift_enabled_) {
+            drift_ = std::make_unique<DriftCompensator>(channels_, MAX_BLOCK_FRAMES);
+            drift_out_.assign(drift_->max_output(MAX_BLOCK_FRAMES) * channels_, 0.0f);
+            LOG_INFO("Clock drift compensation on");
+        }
+    }
+
+    setup_poll();
+    start_streams();
+    return snd_pcm_state(playback_.pcm) == SND_PCM_STATE_RUNNING ||
+           snd_pcm_state(playback_.pcm) == SND_PCM_STATE_PREPARED;
 }
 
 void ALSADevice::close() {
-    if (pcm_capture_) {
-        snd_pcm_drop(pcm_capture_);
-        snd_pcm_close(pcm_capture_);
-        pcm_capture_ = nullptr;
+    drift_.reset();
+    if (linked_ && capture_.pcm) {
+        snd_pcm_unlink(capture_.pcm);
+        linked_ = false;
     }
-    if (pcm_playback_) {
-        snd_pcm_drop(pcm_playback_);
-        snd_pcm_close(pcm_playback_);
-        pcm_playback_ = nullptr;
+    for (Stream* stream : {&capture_, &playback_}) {
+        if (stream->pcm) {
+            snd_pcm_drop(stream->pcm);
+            snd_pcm_close(stream->pcm);
+            stream->pcm = nullptr;
+        }
+    }
+    poll_fds_.clear();
+}
+
+void ALSADevice::setup_poll() {
+    poll_fds_.clear();
+    for (Stream* stream : {&capture_, &playback_}) {
+        stream->first_fd = poll_fds_.size();
+        stream->fd_count = 0;
+        if (!stream->pcm) continue;
+
+        int count = snd_pcm_poll_descriptors_count(stream->pcm);
+        if (count <= 0) continue;
+        poll_fds_.resize(stream->first_fd + count);
+        stream->fd_count = snd_pcm_poll_descriptors(stream->pcm, &poll_fds_[stream->first_fd], count);
+    }
+}
+
+// Playback is primed with a period of silence so the first processed block
+// has somewhere to go; a linked capture stream starts with it
+void ALSADevice::start_streams() {
+    if (playback_.pcm && snd_pcm_state(playback_.pcm) == SND_PCM_STATE_PREPARED) {
+        snd_pcm_sframes_t primed = transfer(playback_, nullptr, silence_.data(), playback_.period);
+        if (primed < 0) {
+            LOG_ERRORF("playback priming failed: %s", snd_strerror(static_cast<int>(primed)));
+        }
+        if (snd_pcm_state(playback_.pcm) == SND_PCM_STATE_PREPARED) {
+            int err = snd_pcm_start(playback_.pcm);
+            if (err < 0) {
+                LOG_ERRORF("Cannot start playback interface: %s", snd_strerror(err));
+            }
+        }
+    }
+
+    if (capture_.pcm && snd_pcm_state(capture_.pcm) == SND_PCM_STATE_PREPARED) {
+        int err = snd_pcm_start(capture_.pcm);
+        if (err < 0) {
+            LOG_ERRORF("Cannot start capture interface: %s", snd_strerror(err));
+        }
+    }
+}
+
+void ALSADevice::recover(Stream& stream, int err) {
+    const char* name = (&stream == &capture_) ? "capture" : "playback";
+    if (err == -EPIPE) {
+        stream.xruns.fetch_add(1, std::memory_order_relaxed);
+        stream.xrun_metric->add();
+        TRACE_INSTANT("xrun");
+        Tracer::instance().request_dump("xrun");
+    }
+    stream.recover_metric->add();
+    if (drift_) drift_->reset();
+    LOG_ERRORF("%s error: %s", name, snd_strerror(err));
+    err = snd_pcm_recover(stream.pcm, err, 1);
+    if (err < 0) {
+        LOG_ERRORF("%s recovery failed: %s", name, snd_strerror(err));
+        return;
+    }
+    // A linked partner stopped with this stream
+    if (linked_) {
+        Stream& other = (&stream == &capture_) ? playback_ : capture_;
+        if (snd_pcm_state(other.pcm) == SND_PCM_STATE_XRUN) {
+            snd_pcm_prepare(other.pcm);
+        }
+    }
+    start_streams();
+}
+
+long ALSADevice::delay_frames() {
+    long total = 0;
+    for (Stream* stream : {&capture_, &playback_}) {
+        snd_pcm_sframes_t delay;
+        if (!stream->pcm || snd_pcm_delay(stream->pcm, &delay) < 0) return -1;
+        total += delay;
+    }
+    return total;
+}
+
+// Read/write access with integer samples converts through staging_, so it
+// must hold the stream's whole buffer
+void ALSADevice::reserve_staging(const Stream& stream, snd_pcm_uframes_t buffer_frames) {
+    if (stream.mmap || stream.format == SND_PCM_FORMAT_FLOAT) return;
+    staging_.resize(std::max(staging_.size(), buffer_frames * channels_ * sample_bytes(stream.format)));
+}
+
+snd_pcm_sframes_t ALSADevice::transfer(Stream& stream, float* read_to, const float* write_from, size_t frames) {
+    if (stream.mmap) {
+        return mmap_transfer(stream.pcm, stream.format, read_to, write_from, frames, channels_);
+    }
+    if (stream.format == SND_PCM_FORMAT_FLOAT) {
+        return read_to ? snd_pcm_readi(stream.pcm, read_to, frames) : snd_pcm_writei(stream.pcm, write_from, frames);
+    }
+
+    const size_t frame_bytes = channels_ * sample_bytes(stream.format);
+    frames = std::min(frames, staging_.size() / frame_bytes);
+    if (read_to) {
+        snd_pcm_sframes_t result = snd_pcm_readi(stream.pcm, staging_.data(), frames);
+        if (result > 0) from_device(stream.format, staging_.data(), read_to, result * channels_);
+        return result;
+    }
+    to_device(stream.format, write_from, staging_.data(), frames * channels_);
+    return snd_pcm_writei(stream.pcm, staging_.data(), frames);
+}
+
+snd_pcm_sframes_t ALSADevice::available(Stream& stream) {
+    snd_pcm_sframes_t avail = snd_pcm_avail_update(stream.pcm);
+    if (avail < 0) {
+        recover(stream, static_cast<int>(avail));
+        return -1;
+    }
+    return avail;
+}
+
+bool ALSADevice::poll_streams(bool capture, bool playback, int timeout_ms) {
+    // The descriptors are laid out capture first, then playback
+    size_t first = capture ? capture_.first_fd : playback_.first_fd;
+    size_t count = (capture ? capture_.fd_count : 0) + (playback ? playback_.fd_count : 0);
+    if (count == 0) return false;
+
+    int ready = poll(&poll_fds_[first], count, timeout_ms);
+    if (ready <= 0) return false;
+
+    // Let the plugins translate their descriptor events
+    unsigned short revents;
+    if (capture) {
+        snd_pcm_poll_descriptors_revents(capture_.pcm, &poll_fds_[capture_.first_fd], capture_.fd_count, &revents);
+    }
+    if (playback) {
+        snd_pcm_poll_descriptors_revents(playback_.pcm, &poll_fds_[playback_.first_fd], playback_.fd_count, &revents);
+    }
+    return true;
+}
+
+bool ALSADevice::wait(int timeout_ms) {
+    for (;;) {
+        bool capture_ready = !capture_.pcm || available(capture_) >= static_cast<snd_pcm_sframes_t>(capture_.period);
+        bool playback_ready = !playback_.pcm || available(playback_) >= static_cast<snd_pcm_sframes_t>(playback_.period);
+        if (capture_ready && playback_ready) return true;
+
+        if (!poll_streams(!capture_ready, !playback_ready, timeout_ms)) {
+            return false;
+        }
     }
 }
 
 int ALSADevice::capture(float* buffer, int frames) {
-    if (!pcm_capture_) return 0;
+    if (!capture_.pcm) return 0;
+
+    snd_pcm_sframes_t avail = available(capture_);
+    if (avail <= 0) return 0;
 
-    snd_pcm_sframes_t result = snd_pcm_readi(pcm_capture_, buffer, frames);
+    snd_pcm_uframes_t n = std::min<snd_pcm_uframes_t>(avail, frames);
+    snd_pcm_sframes_t result = transfer(capture_, buffer, nullptr, n);
 
     if (result == -EAGAIN) {
         return 0;
     } else if (result < 0) {
-        LOG_ERROR(std::string("capture error: ") + snd_strerror(result));
-        result = snd_pcm_recover(pcm_capture_, (int)result, 0);
-        if (result < 0) {
-            LOG_ERROR(std::string("capture recovery failed: ") + snd_strerror(result));
-            return 0;
-        }
+        recover(capture_, static_cast<int>(result));
         return 0;
     }
 
     return (int)result;
 }
 
+// With separate clocks the block is resampled first, steered by the delay
+// of both streams just before it is written
 int ALSADevice::playback(const float* buffer, int frames) {
-    if (!pcm_playback_) return 0;
-
-    snd_pcm_sframes_t result = snd_pcm_writei(pcm_playback_, buffer, frames);
+    if (!playback_.pcm) return 0;
+    if (!drift_) return write_playback(buffer, frames);
 
-    if (result == -EAGAIN) {
-        usleep(1000);
-        result = snd_pcm_writei(pcm_playback_, buffer, frames);
-        if (result == -EAGAIN) {
-            return 0;
+    int done = 0;
+    while (done < frames) {
+        size_t n = std::min<size_t>(frames - done, drift_->max_frames());
+        bool locked = drift_->locked();
+        drift_->update(delay_frames(), n);
+        if (!locked && drift_->locked()) {
+            LOG_INFOF("Clock drift compensation: holding %.0f frames of delay", drift_->target());
         }
+        int resampled = static_cast<int>(drift_->process(buffer + static_cast<size_t>(done) * channels_, n,
+                                                         drift_out_.data()));
+        if (write_playback(drift_out_.data(), resampled) < resampled) break;
+        done += static_cast<int>(n);
     }
-    
-    if (result < 0) {
-        LOG_ERROR(std::string("playback error: ") + snd_strerror(result));
-        result = snd_pcm_recover(pcm_playback_, (int)result, 0);
+    drift_metric_.set(drift_->ppm());
+    return done;
+}
+
+// Writes the whole block, sleeping in poll() while the device ring is full
+int ALSADevice::write_playback(const float* buffer, int frames) {
+    int done = 0;
+    int failures = 0;
+    while (done < frames && failures < MAX_RECOVERIES) {
+        snd_pcm_sframes_t avail = available(playback_);
+        if (avail < 0) {
+            failures++;
+            continue;
+        }
+        if (avail == 0) {
+            if (!poll_streams(false, true, 1000)) {
+                LOG_ERRORF("playback stalled, dropping %d frames", frames - done);
+                break;
+            }
+            continue;
+        }
+
+        snd_pcm_uframes_t n = std::min<snd_pcm_uframes_t>(avail, frames - done);
+        const float* src = buffer + static_cast<size_t>(done) * channels_;
+        snd_pcm_sframes_t result = transfer(playback_, nullptr, src, n);
+
+        if (result == -EAGAIN) continue;
         if (result < 0) {
-            LOG_ERROR(std::string("recovery failed: ") + snd_strerror(result));
-            return 0;
+            recover(playback_, static_cast<int>(result));
+            failures++;
+            continue;
         }
-        return 0;
+        done += static_cast<int>(result);
     }
 
-    return (int)result;
+    if (done < frames) {
+        dropped_metric_.add(static_cast<uint64_t>(frames - done));
+    }
+    return done;
 }
@@ -2,28 +2,110 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <poll.h>
 #include <alsa/asoundlib.h>
+#include "audio/backend.h"
+#include "audio/drift.h"
+#include "audio/params.h"
+#include "utils/metrics.h"
+#include "config.h"
 
-class ALSADevice {
+// ALSA capture/playback.
+// Both PCMs are non-blocking; wait() sleeps in poll() on the descriptors of
+// both streams until capture has a period and playback has room for one.
+// Transfers go straight to/from the device ring with MMAP_INTERLEAVED access
+// when the PCM supports it (RW_INTERLEAVED otherwise). The streams are
+// linked when possible so they start and recover together, and playback is
+// primed with one period of silence.
+// The period size and count are requests (0 = driver default); the
+// negotiated values can differ and are logged on open.
+//
+// Each stream negotiates its own sample format (see SampleFormat) and the
+// device's own rate: ALSA's plug layer is asked not to resample, so `hw:`
+// devices open without a plug in the path. Integer samples are converted to
+// and from float with the simd kernels in the same pass that copies them
+// out of or into the device ring.
+//
+// Streams that cannot be linked run on separate clocks; unless disabled,
+// playback then goes through a DriftCompensator that keeps their combined
+// delay constant.
+class ALSADevice : public AudioBackend {
 public:
-    ALSADevice();
-    ~ALSADevice();
+    explicit ALSADevice(int channels = 1, snd_pcm_uframes_t period_size = 0, unsigned int periods = 0,
+                        int sample_rate = SAMPLE_RATE, SampleFormat format = SampleFormat::AUTO);
+    ~ALSADevice() override;
 
-    bool open_capture(const char* device_name = "default");
-    bool open_playback(const char* device_name = "default");
-    void close();
+    // Call before open_playback()
+    void set_drift_compensation(bool enabled) { drift_enabled_ = enabled; }
 
-    int capture(float* buffer, int frames);
-    int playback(const float* buffer, int frames);
+    bool open_capture(const char* device_name = "default") override;
+    bool open_playback(const char* device_name = "default") override;
+    void close() override;
 
-    int get_sample_rate() const { return sample_rate_; }
-    int get_channels() const { return channels_; }
+    int capture(float* buffer, int frames) override;
+    int playback(const float* buffer, int frames) override;
+    bool wait(int timeout_ms) override;
+
+    int get_sample_rate() const override { return sample_rate_; }
+    int get_channels() const override { return channels_; }
     int get_buffer_size() const { return static_cast<int>(buffer_size_); }
+    int get_period_size() const { return static_cast<int>(capture_.pcm ? capture_.period : playback_.period); }
+    int get_periods() const { return static_cast<int>(capture_.pcm ? capture_.periods : playback_.periods); }
+
+    // Over- and underruns since open, from any thread
+    uint64_t capture_xruns() const override { return capture_.xruns.load(std::memory_order_relaxed); }
+    uint64_t playback_xruns() const override { return playback_.xruns.load(std::memory_order_relaxed); }
+    uint64_t xruns() const { return capture_xruns() + playback_xruns(); }
+    long delay_frames() override;
 
 private:
-    snd_pcm_t* pcm_capture_;
-    snd_pcm_t* pcm_playback_;
+    struct Stream {
+        snd_pcm_t* pcm = nullptr;
+        bool mmap = false;
+        snd_pcm_format_t format = SND_PCM_FORMAT_FLOAT;
+        snd_pcm_uframes_t period = 0;
+        unsigned int periods = 0;
+        size_t first_fd = 0;   // this stream's descriptors in poll_fds_
+        size_t fd_count = 0;
+        std::atomic<uint64_t> xruns{0};
+        Counter* xrun_metric = nullptr;
+        Counter* recover_metric = nullptr;
+    };
+
+    // Frames available, or -1 after an xrun (the streams are restarted)
+    snd_pcm_sframes_t available(Stream& stream);
+    // Up to frames frames between the device and interleaved floats,
+    // converting on the way; returns the frames moved or a negative error
+    snd_pcm_sframes_t transfer(Stream& stream, float* read_to, const float* write_from, size_t frames);
+    void reserve_staging(const Stream& stream, snd_pcm_uframes_t buffer_frames);
+    bool poll_streams(bool capture, bool playback, int timeout_ms);
+    void recover(Stream& stream, int err);
+    int write_playback(const float* buffer, int frames);
+    void start_streams();
+    void setup_poll();
+    std::string describe(const Stream& stream, const char* name) const;
+
+    Stream capture_;
+    Stream playback_;
     int sample_rate_;
     int channels_;
-    snd_pcm_uframes_t buffer_size_;
+    snd_pcm_uframes_t period_size_;  // requested
+    unsigned int periods_;
+    snd_pcm_uframes_t buffer_size_;  // negotiated capture buffer
+    SampleFormat requested_format_;
+    bool linked_;
+    bool drift_enabled_;
+    std::unique_ptr<DriftCompensator> drift_;  // separate clocks only
+    std::vector<float> drift_out_;
+
+    Counter& dropped_metric_;
+    Gauge& drift_metric_;
+
+    std::vector<pollfd> poll_fds_;
+    std::vector<float> silence_;
+    std::vector<uint8_t> staging_;  // read/write access with integer samples
 };
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+
+// Capture/playback interface shared by the ALSA, WAV file and null backends.
+// Buffers hold interleaved float frames of get_channels() samples in
+// [-1, 1]. capture() and playback() return the number of frames
+// transferred, 0 when nothing could be transferred.
+class AudioBackend {
+public:
+    virtual ~AudioBackend() = default;
+
+    // device_name is backend specific: ALSA PCM name, WAV path, ...
+    virtual bool open_capture(const char* device_name) = 0;
+    virtual bool open_playback(const char* device_name) = 0;
+    virtual void close() = 0;
+
+    virtual int capture(float* buffer, int frames) = 0;
+    virtual int playback(const float* buffer, int frames) = 0;
+
+    virtual int get_sample_rate() const = 0;
+    virtual int get_channels() const = 0;
+
+    // True once the capture side has no more input (end of file, ...)
+    virtual bool finished() const { return false; }
+
+    // Sleeps until capture has a period of input and playback has room for
+    // one, or timeout_ms passes (false). Backends that never block return
+    // true at once.
+    virtual bool wait(int timeout_ms) { (void)timeout_ms; return true; }
+
+    // Diagnostics for the performance overlay; backends without a device
+    // clock report no xruns and an unknown (-1) delay
+    virtual uint64_t capture_xruns() const { return 0; }
+    virtual uint64_t playback_xruns() const { return 0; }
+    // Frames between the application and the converters, capture + playback
+    virtual long delay_frames() { return -1; }
+};
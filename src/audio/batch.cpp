@@ -0,0 +1,249 @@
+#include "audio/batch.h"
+#include "audio/wav_file.h"
+#include "dsp/multichannel.h"
+#include "utils/fs.h"
+#include "utils/logger.h"
+#include "utils/thread_pool.h"
+#include "config.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <set>
+#include <dirent.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+namespace {
+    bool has_wav_extension(const std::string& path) {
+        return path.size() > 4 && strcasecmp(path.c_str() + path.size() - 4, ".wav") == 0;
+    }
+
+    std::string base_name(const std::string& path) {
+        size_t slash = path.find_last_of('/');
+        return slash == std::string::npos ? path : path.substr(slash + 1);
+    }
+
+    off_t file_size(const std::string& path) {
+        struct stat st;
+        return stat(path.c_str(), &st) == 0 ? st.st_size : 0;
+    }
+}
+
+BatchProcessor::BatchProcessor(float pitch_ratio, bool phase_lock, const AudioParams& params, size_t threads)
+    : pitch_ratio_(pitch_ratio), phase_lock_(phase_lock), params_(params), threads_(threads), wall_seconds_(0.0) {
+}
+
+bool BatchProcessor::add_input(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) < 0) {
+        LOG_ERROR("Batch input not found: " + path);
+        return false;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        DIR* dir = opendir(path.c_str());
+        if (!dir) {
+            LOG_ERROR("Cannot read directory: " + path);
+            return false;
+        }
+        std::vector<std::string> found;
+        while (dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name[0] != '.' && has_wav_extension(name)) {
+                found.push_back(path + "/" + name);
+            }
+        }
+        closedir(dir);
+        std::sort(found.begin(), found.end());
+        inputs_.insert(inputs_.end(), found.begin(), found.end());
+        return true;
+    }
+
+    if (has_wav_extension(path)) {
+        inputs_.push_back(path);
+        return true;
+    }
+
+    // Anything else is a list of WAV files and directories
+    std::ifstream list(path);
+    if (!list) {
+        LOG_ERROR("Cannot read batch list: " + path);
+        return false;
+    }
+    std::string line;
+    bool ok = true;
+    while (std::getline(list, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        struct stat entry;
+        if (stat(line.c_str(), &entry) == 0 && !S_ISDIR(entry.st_mode) && !has_wav_extension(line)) {
+            LOG_ERROR("Not a WAV file or directory: " + line);
+            ok = false;
+            continue;
+        }
+        ok = add_input(line) && ok;
+    }
+    return ok;
+}
+
+bool BatchProcessor::run(const std::atomic<bool>& running) {
+    results_.assign(inputs_.size(), BatchResult{});
+    std::string dir_error;
+    if (!output_dir_.empty() && !make_dirs(output_dir_)) {
+        dir_error = "Cannot create output directory '" + output_dir_ + "': " + std::strerror(errno);
+        LOG_ERROR(dir_error);
+    }
+
+    std::set<std::string> outputs;
+    for (size_t i = 0; i < inputs_.size(); i++) {
+        results_[i].input = inputs_[i];
+        if (output_dir_.empty()) continue;
+        if (!dir_error.empty()) {
+            results_[i].error = dir_error;
+            continue;
+        }
+
+        std::string output = output_dir_ + "/" + base_name(inputs_[i]);
+        if (!outputs.insert(output).second) {
+            results_[i].error = "Output name already used by another input";
+            LOG_ERROR("Skipping " + inputs_[i] + ": output name already used by another input");
+            continue;
+        }
+        results_[i].output = output;
+    }
+
+    // Longest files first, so a big file dealt last doesn't leave one core
+    // busy while the others idle
+    std::vector<size_t> order(inputs_.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::vector<off_t> sizes(inputs_.size());
+    for (size_t i = 0; i < inputs_.size(); i++) sizes[i] = file_size(inputs_[i]);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    {
+        ThreadPool pool(threads_);
+        threads_ = pool.size();
+        LOG_INFO("Batch: " + std::to_string(inputs_.size()) + " files on " +
+                 std::to_string(threads_) + " threads");
+
+        for (size_t i : order) {
+            if (!output_dir_.empty() && results_[i].output.empty()) continue;
+            BatchResult* result = &results_[i];
+            pool.submit([this, result, &running] { process_file(*result, running); });
+        }
+        pool.wait();
+    }
+    wall_seconds_ = std::chrono::duration<double>(clock::now() - start).count();
+
+    return std::all_of(results_.begin(), results_.end(), [](const BatchResult& r) { return r.ok; });
+}
+
+void BatchProcessor::process_file(BatchResult& result, const std::atomic<bool>& running) const {
+    if (!running) {
+        result.error = "Interrupted";
+        return;
+    }
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+
+    WavFileBackend wav;
+    if (!wav.open_capture(result.input.c_str())) {
+        result.error = wav.error();
+        return;
+    }
+
+    // Never overwrite the input in place
+    struct stat in_st, out_st;
+    if (!result.output.empty() && stat(result.input.c_str(), &in_st) == 0 &&
+        stat(result.output.c_str(), &out_st) == 0 &&
+        in_st.st_dev == out_st.st_dev && in_st.st_ino == out_st.st_ino) {
+        result.error = "Output would overwrite its input: " + result.output;
+        LOG_ERROR(result.error);
+        return;
+    }
+    if (!result.output.empty() && !wav.open_playback(result.output.c_str())) {
+        result.error = wav.error();
+        return;
+    }
+
+    const int channels = wav.get_channels();
+    const int block = params_.block_frames;
+    MultiChannelShifter shifter(channels, params_.fft_size, params_.hop_size, wav.get_sample_rate(), phase_lock_, 1);
+    shifter.set_pitch_ratio(pitch_ratio_);
+
+    std::vector<float> input_buffer(static_cast<size_t>(block) * channels);
+    std::vector<float> output_buffer(static_cast<size_t>(block) * channels);
+
+    // Drop the first latency_samples() of output and pad the input with
+    // silence at the end, so the output is aligned and as long as the input
+    size_t skip = shifter.latency_samples();
+    size_t remaining = wav.total_frames();
+    while (remaining > 0 && running) {
+        int captured = wav.capture(input_buffer.data(), block);
+        if (captured <= 0) {
+            captured = block;
+            std::fill(input_buffer.begin(), input_buffer.end(), 0.0f);
+        }
+        shifter.process(input_buffer.data(), output_buffer.data(), captured);
+
+        size_t offset = std::min(skip, static_cast<size_t>(captured));
+        size_t count = std::min(captured - offset, remaining);
+        skip -= offset;
+        if (!result.output.empty() &&
+            wav.playback(output_buffer.data() + offset * channels, static_cast<int>(count)) == 0 && count > 0) {
+            break;
+        }
+        remaining -= count;
+    }
+    wav.close();
+
+    result.channels = channels;
+    result.sample_rate = wav.get_sample_rate();
+    result.frames = wav.total_frames();
+    result.ok = (remaining == 0);
+    result.seconds = std::chrono::duration<double>(clock::now() - start).count();
+    if (!result.ok) {
+        result.error = running ? "Cannot write " + result.output : "Interrupted";
+        LOG_ERROR("Batch job did not finish: " + result.input);
+    }
+}
+
+void BatchProcessor::print_report() const {
+    size_t failed = 0;
+    size_t total_samples = 0;
+    double audio_seconds = 0.0;
+    double job_seconds = 0.0;
+
+    std::printf("%-40s %3s %10s %9s %10s %12s\n", "file", "ch", "audio s", "wall s", "x realtime", "samples/s");
+    for (const BatchResult& r : results_) {
+        std::string name = base_name(r.input);
+        if (name.size() > 40) name = "..." + name.substr(name.size() - 37);
+        if (!r.ok) {
+            std::printf("%-40s %3s %10s %9s %10s %12s\n", name.c_str(), "-", "-", "-", "-", "FAILED");
+            if (!r.error.empty()) std::printf("  %s\n", r.error.c_str());
+            failed++;
+            continue;
+        }
+
+        double seconds = static_cast<double>(r.frames) / r.sample_rate;
+        size_t samples = r.frames * r.channels;
+        std::printf("%-40s %3d %10.2f %9.3f %10.1f %12.4g\n", name.c_str(), r.channels, seconds,
+                    r.seconds, seconds / r.seconds, samples / r.seconds);
+        total_samples += samples;
+        audio_seconds += seconds;
+        job_seconds += r.seconds;
+    }
+
+    std::printf("Batch: %zu files (%zu failed) on %zu threads in %.3f s\n",
+                results_.size(), failed, threads_, wall_seconds_);
+    if (wall_seconds_ > 0.0) {
+        std::printf("  aggregate: %zu samples, %.4g samples/s, %.1fx real time\n",
+                    total_samples, total_samples / wall_seconds_, audio_seconds / wall_seconds_);
+        std::printf("  job concurrency: %.2fx (sum of job times / wall time)\n", job_seconds / wall_seconds_);
+    }
+}
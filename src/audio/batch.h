@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "audio/params.h"
+
+struct BatchResult {
+    std::string input;
+    std::string output;  // empty when no output directory was given
+    bool ok = false;
+    std::string error;   // why it failed, for the report
+    int channels = 0;
+    int sample_rate = 0;
+    size_t frames = 0;
+    double seconds = 0.0;  // wall time of this file's job
+};
+
+// Offline pitch shifting of many WAV files.
+// Each file is one job on a work-stealing ThreadPool sized to the cores. A
+// job streams its file through the mmap WAV backend one block_frames block
+// at a time with its own MultiChannelShifter (kept single-threaded, since the
+// pool already fills the cores). Memory per job is bounded by the shifter
+// state and the WAV backend's streaming window. The DSP latency is trimmed
+// from the output so it lines up with the input and has the same length.
+class BatchProcessor {
+public:
+    BatchProcessor(float pitch_ratio, bool phase_lock, const AudioParams& params, size_t threads = 0);
+
+    // A WAV file, a directory (all *.wav inside, sorted) or a text file
+    // listing one path per line
+    bool add_input(const std::string& path);
+    // Outputs go to <dir>/<input file name>; without one nothing is written
+    void set_output_dir(const std::string& dir) { output_dir_ = dir; }
+
+    size_t file_count() const { return inputs_.size(); }
+
+    // Processes every file; returns false if any job failed. Jobs that have
+    // not started when `running` goes false are skipped.
+    bool run(const std::atomic<bool>& running);
+
+    // Per-file timing and aggregate throughput
+    void print_report() const;
+
+private:
+    void process_file(BatchResult& result, const std::atomic<bool>& running) const;
+
+    float pitch_ratio_;
+    bool phase_lock_;
+    AudioParams params_;  // sample_rate unused, files keep their own
+    size_t threads_;
+    std::string output_dir_;
+    std::vector<std::string> inputs_;
+    std::vector<BatchResult> results_;
+    double wall_seconds_;
+};
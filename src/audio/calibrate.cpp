@@ -0,0 +1,131 @@
+#include "audio/calibrate.h"
+#include "audio/alsa.h"
+#include "dsp/multichannel.h"
+#include "utils/fs.h"
+#include "utils/logger.h"
+#include "config.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+namespace {
+    // A stable period depends on the DSP load as well as the devices
+    std::string cache_path(const std::string& cache_dir, const std::string& capture_device,
+                           const std::string& playback_device, int channels, const AudioParams& params) {
+        std::string name = "latency-" + capture_device + "-" + playback_device + "-" + std::to_string(channels) +
+                           "ch-" + std::to_string(params.sample_rate) + "hz-fft" + std::to_string(params.fft_size) +
+                           "-hop" + std::to_string(params.hop_size);
+        for (char& c : name) {
+            if (c == '/') c = '_';
+        }
+        return cache_dir + "/" + name;
+    }
+}
+
+LatencyCalibrator::LatencyCalibrator(const std::string& capture_device, const std::string& playback_device,
+                                     int channels, unsigned int periods, const AudioParams& params)
+    : capture_device_(capture_device), playback_device_(playback_device),
+      channels_(channels), periods_(periods > 0 ? periods : CALIBRATE_PERIODS), params_(params) {
+}
+
+long LatencyCalibrator::trial(unsigned long period_size, const std::atomic<bool>& running,
+                              LatencySetting& negotiated) {
+    ALSADevice device(channels_, period_size, periods_, params_.sample_rate, params_.sample_format);
+    if (!device.open_capture(capture_device_.c_str()) || !device.open_playback(playback_device_.c_str())) {
+        return -1;
+    }
+    negotiated.period_size = static_cast<unsigned long>(device.get_period_size());
+    negotiated.periods = static_cast<unsigned int>(device.get_periods());
+
+    MultiChannelShifter shifter(device.get_channels(), params_.fft_size, params_.hop_size, device.get_sample_rate());
+    shifter.set_pitch_ratio(1.5f);
+    std::vector<float> input_buffer(static_cast<size_t>(params_.block_frames) * device.get_channels());
+    std::vector<float> output_buffer(static_cast<size_t>(params_.block_frames) * device.get_channels());
+
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    auto warmed_up = start + std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(CALIBRATE_WARMUP_SECONDS));
+    auto end = start + std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(CALIBRATE_SECONDS));
+    uint64_t baseline = 0;
+    bool counting = false;
+
+    while (running && clock::now() < end) {
+        if (!counting && clock::now() >= warmed_up) {
+            baseline = device.xruns();
+            counting = true;
+        }
+        if (!device.wait(AUDIO_WAIT_TIMEOUT_MS)) continue;
+
+        int captured = device.capture(input_buffer.data(), params_.block_frames);
+        if (captured <= 0) continue;
+        shifter.process(input_buffer.data(), output_buffer.data(), captured);
+        device.playback(output_buffer.data(), captured);
+    }
+
+    long xruns = counting ? static_cast<long>(device.xruns() - baseline) : 0;
+    device.close();
+    return xruns;
+}
+
+bool LatencyCalibrator::run(const std::atomic<bool>& running, LatencySetting& result) {
+    bool found = false;
+    LatencySetting stable;
+
+    for (unsigned long period = CALIBRATE_MAX_PERIOD; period >= CALIBRATE_MIN_PERIOD && running; period /= 2) {
+        LatencySetting negotiated;
+        long xruns = trial(period, running, negotiated);
+        if (xruns < 0) {
+            std::printf("  period %5lu: cannot open devices\n", period);
+            break;
+        }
+
+        std::printf("  period %5lu x %u (%6.2f ms): %ld xruns\n", negotiated.period_size, negotiated.periods,
+                    1000.0 * negotiated.period_size * negotiated.periods / params_.sample_rate, xruns);
+        std::fflush(stdout);
+        if (xruns > 0) break;
+
+        // The driver may round; stop once it no longer goes lower
+        if (found && negotiated.period_size >= stable.period_size) break;
+        stable = negotiated;
+        found = true;
+    }
+
+    if (!found) return false;
+
+    result = stable;
+    result.period_size = std::min(stable.period_size * CALIBRATE_MARGIN, CALIBRATE_MAX_PERIOD);
+    LOG_INFO("Calibrated latency: period " + std::to_string(result.period_size) + " x " +
+             std::to_string(result.periods) + " (smallest stable " + std::to_string(stable.period_size) + ")");
+    return true;
+}
+
+bool LatencyCalibrator::load(const std::string& cache_dir, const std::string& capture_device,
+                             const std::string& playback_device, int channels, const AudioParams& params,
+                             LatencySetting& setting) {
+    std::ifstream file(cache_path(cache_dir, capture_device, playback_device, channels, params));
+    LatencySetting loaded;
+    if (!(file >> loaded.period_size >> loaded.periods) || loaded.period_size == 0) {
+        return false;
+    }
+    setting = loaded;
+    return true;
+}
+
+bool LatencyCalibrator::save(const std::string& cache_dir, const std::string& capture_device,
+                             const std::string& playback_device, int channels, const AudioParams& params,
+                             const LatencySetting& setting) {
+    make_dirs(cache_dir);
+    std::string path = cache_path(cache_dir, capture_device, playback_device, channels, params);
+    std::ofstream file(path);
+    file << setting.period_size << " " << setting.periods << "\n";
+    if (!file) {
+        LOG_ERROR("Cannot save latency calibration to " + path);
+        return false;
+    }
+    LOG_INFO("Saved latency calibration to " + path);
+    return true;
+}
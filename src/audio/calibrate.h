@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include "audio/params.h"
+
+struct LatencySetting {
+    unsigned long period_size = 0;  // frames
+    unsigned int periods = 0;
+};
+
+// Finds the smallest ALSA period size that runs without xruns.
+// Starting at CALIBRATE_MAX_PERIOD, each trial opens the devices with half
+// the previous period and runs the full capture -> pitch shift -> playback
+// chain for CALIBRATE_SECONDS, so the DSP load (including the FFT frame that
+// lands in a single period every hop) is the real one. Stepping stops at the
+// first trial with xruns; the result is the smallest stable period times
+// CALIBRATE_MARGIN. Results are cached per device pair, channel count,
+// sample rate, FFT size and hop.
+class LatencyCalibrator {
+public:
+    LatencyCalibrator(const std::string& capture_device, const std::string& playback_device,
+                      int channels, unsigned int periods, const AudioParams& params);
+
+    // false if not even the largest period was stable
+    bool run(const std::atomic<bool>& running, LatencySetting& result);
+
+    static bool load(const std::string& cache_dir, const std::string& capture_device,
+                     const std::string& playback_device, int channels, const AudioParams& params,
+                     LatencySetting& setting);
+    static bool save(const std::string& cache_dir, const std::string& capture_device,
+                     const std::string& playback_device, int channels, const AudioParams& params,
+                     const LatencySetting& setting);
+
+private:
+    // xruns during one trial, or -1 if the devices would not open
+    long trial(unsigned long period_size, const std::atomic<bool>& running, LatencySetting& negotiated);
+
+    std::string capture_device_;
+    std::string playback_device_;
+    int channels_;
+    unsigned int periods_;
+    AudioParams params_;
+};
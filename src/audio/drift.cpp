@@ -0,0 +1,72 @@
+#include "audio/drift.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    constexpr size_t HISTORY = 3;  // frames kept for the interpolator's taps
+
+    // 4-point cubic Hermite (Catmull-Rom) between x0 and x1, t in [0, 1)
+    inline float hermite(float xm1, float x0, float x1, float x2, float t) {
+        float c1 = 0.5f * (x1 - xm1);
+        float c2 = xm1 - 2.5f * x0 + 2.0f * x1 - 0.5f * x2;
+        float c3 = 0.5f * (x2 - xm1) + 1.5f * (x0 - x1);
+        return ((c3 * t + c2) * t + c1) * t + x0;
+    }
+}
+
+DriftCompensator::DriftCompensator(int channels, size_t max_frames)
+    : channels_(channels), max_frames_(max_frames),
+      work_((HISTORY + max_frames) * channels, 0.0f),
+      position_(1.0), ratio_(1.0), integral_(0.0), delay_(0.0), target_(0.0), blocks_(0) {
+}
+
+void DriftCompensator::reset() {
+    blocks_ = 0;
+}
+
+// Until the target is taken the ratio is left alone (1.0, or the estimate
+// from before an xrun)
+void DriftCompensator::update(long delay_frames, size_t frames) {
+    if (delay_frames < 0) return;
+
+    if (blocks_ == 0) {
+        delay_ = static_cast<double>(delay_frames);
+    } else {
+        delay_ += DRIFT_SMOOTHING * (delay_frames - delay_);
+    }
+    if (blocks_ < DRIFT_SETTLE_BLOCKS) {
+        if (++blocks_ == DRIFT_SETTLE_BLOCKS) target_ = delay_;
+        return;
+    }
+
+    // Below target, playback drains faster than capture fills: stretch
+    const double limit = DRIFT_MAX_PPM * 1e-6;
+    double error = target_ - delay_;
+    integral_ = std::max(-limit, std::min(integral_ + DRIFT_KI * error * frames, limit));
+    ratio_ = 1.0 + std::max(-limit, std::min(DRIFT_KP * error + integral_, limit));
+}
+
+size_t DriftCompensator::process(const float* in, size_t frames, float* out) {
+    const size_t channels = static_cast<size_t>(channels_);
+    std::memcpy(&work_[HISTORY * channels], in, frames * channels * sizeof(float));
+
+    // Each output frame needs input frames i - 1 .. i + 2
+    const double end = static_cast<double>(HISTORY + frames - 2);
+    const double step = 1.0 / ratio_;
+    size_t produced = 0;
+    for (; position_ < end; position_ += step) {
+        size_t i = static_cast<size_t>(position_);
+        float t = static_cast<float>(position_ - i);
+        const float* x = &work_[(i - 1) * channels];
+        float* frame = out + produced * channels;
+        for (size_t c = 0; c < channels; c++) {
+            frame[c] = hermite(x[c], x[channels + c], x[2 * channels + c], x[3 * channels + c], t);
+        }
+        produced++;
+    }
+
+    // The newest frames become the next call's history
+    std::memmove(work_.data(), &work_[frames * channels], HISTORY * channels * sizeof(float));
+    position_ -= static_cast<double>(frames);
+    return produced;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "config.h"
+
+// Adaptive resampling between capture and playback devices on separate
+// clocks. Playback audio goes through a variable-ratio resampler (4-point
+// cubic Hermite, output frames per input frame = 1 + ppm() / 1e6), and a
+// PI loop steers the ratio so the combined capture + playback delay stays
+// at the value measured once the streams have settled. Corrections are limited to
+// +-DRIFT_MAX_PPM, far beyond real crystal drift, so the pitch change is
+// inaudible.
+//
+// Everything is preallocated for blocks of up to max_frames; process() and
+// update() run on the audio thread and never allocate.
+class DriftCompensator {
+public:
+    DriftCompensator(int channels, size_t max_frames);
+
+    // Total capture + playback delay, measured before each block of frames
+    // is written
+    void update(long delay_frames, size_t frames);
+
+    // Resamples frames interleaved input frames (at most max_frames) into
+    // out, which must hold max_output(frames); returns the frames written
+    size_t process(const float* in, size_t frames, float* out);
+    size_t max_output(size_t frames) const { return static_cast<size_t>(frames * (1.0 + DRIFT_MAX_PPM * 1e-6)) + 2; }
+    size_t max_frames() const { return max_frames_; }
+
+    // After an xrun the delay jumps; settle again on a new target
+    void reset();
+
+    // Current correction: output frames per input frame, minus one, in ppm
+    double ppm() const { return (ratio_ - 1.0) * 1e6; }
+    bool locked() const { return blocks_ >= DRIFT_SETTLE_BLOCKS; }
+    double target() const { return target_; }
+
+private:
+    int channels_;
+    size_t max_frames_;
+    std::vector<float> work_;  // HISTORY frames, then the new input
+    double position_;          // read position in work_, in frames
+    double ratio_;
+    double integral_;
+    double delay_;             // smoothed
+    double target_;
+    int blocks_;
+};
@@ -0,0 +1,308 @@
+#include "audio/engine.h"
+#include "dsp/utils.h"
+#include "utils/alloc_check.h"
+#include "utils/logger.h"
+#include "utils/trace.h"
+#include "config.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+    AudioStats make_stats_prototype() {
+        AudioStats stats{};
+        stats.spectrum.resize(SPECTRUM_BARS, SPECTRUM_MIN_DB);
+        return stats;
+    }
+}
+
+AudioMetrics::AudioMetrics()
+    : blocks(MetricsRegistry::instance().counter("vocoder_blocks_total", "Audio blocks processed")),
+      frames(MetricsRegistry::instance().counter("vocoder_frames_total", "Audio frames processed")),
+      block_seconds(MetricsRegistry::instance().histogram("vocoder_block_seconds", "DSP time per block",
+          {0.0005, 0.001, 0.002, 0.005, 0.01, 0.02, 0.05})),
+      input_level_db(MetricsRegistry::instance().gauge("vocoder_input_level_db", "Input RMS level of the last block")),
+      output_level_db(MetricsRegistry::instance().gauge("vocoder_output_level_db", "Output RMS level of the last block")) {
+}
+
+void AudioMetrics::update(int block_frames, double seconds, float input_db, float output_db) {
+    blocks.add();
+    frames.add(static_cast<uint64_t>(block_frames));
+    block_seconds.observe(seconds);
+    input_level_db.set(input_db);
+    output_level_db.set(output_db);
+}
+
+AudioEngine::AudioEngine(AudioBackend& device, MultiChannelShifter& shifter, int block_frames)
+    : device_(device), shifter_(shifter),
+      channels_(device.get_channels()), block_frames_(block_frames),
+      running_(false), muted_(false), volume_(shifter.get_volume()),
+      pitch_ratio_(shifter.get_pitch_ratio()), frame_clock_(0), controls_(CONTROL_QUEUE_SIZE),
+      loopback_requested_(false),
+      window_busy_us_(0.0), window_audio_us_(0.0),
+      previous_busy_us_(0.0), previous_audio_us_(0.0),
+      load_peak_(0.0f), previous_load_peak_(0.0f), frames_(0),
+      applied_muted_(false), applied_volume_(shifter.get_volume()),
+      spectrum_bands_(shifter.fft_size(), device.get_sample_rate()),
+      spectrum_(SPECTRUM_BARS, SPECTRUM_MIN_DB), spectrum_due_(0), ui_fps_(UI_FPS),
+      realtime_report_(nullptr), thread_ready_(false),
+      loopback_(LoopbackState::IDLE), loopback_frame_(0),
+      loopback_threshold_(0.0f), loopback_ms_(0.0f),
+      input_buffer_(static_cast<size_t>(block_frames) * channels_),
+      output_buffer_(static_cast<size_t>(block_frames) * channels_),
+      stats_queue_(STATS_QUEUE_SIZE, make_stats_prototype()) {
+}
+
+AudioEngine::~AudioEngine() {
+    stop();
+}
+
+bool AudioEngine::send(const ControlCommand& command) {
+    size_t ticket;
+    ControlCommand* slot = controls_.begin_write(ticket);
+    if (!slot) return false;
+    *slot = command;
+    controls_.commit_write(ticket);
+    return true;
+}
+
+bool AudioEngine::set_muted(bool muted, uint64_t at_frame) {
+    if (!send(ControlCommand{ControlCommand::Type::MUTE, muted ? 1.0f : 0.0f, at_frame})) return false;
+    muted_.store(muted, std::memory_order_relaxed);
+    return true;
+}
+
+bool AudioEngine::set_volume(float vol, uint64_t at_frame) {
+    vol = std::max(0.0f, std::min(vol, 1.0f));
+    if (!send(ControlCommand{ControlCommand::Type::VOLUME, vol, at_frame})) return false;
+    volume_.store(vol, std::memory_order_relaxed);
+    return true;
+}
+
+bool AudioEngine::set_pitch_ratio(float ratio, uint64_t at_frame) {
+    ratio = std::max(0.25f, std::min(ratio, 4.0f));
+    if (!send(ControlCommand{ControlCommand::Type::PITCH, ratio, at_frame})) return false;
+    pitch_ratio_.store(ratio, std::memory_order_relaxed);
+    return true;
+}
+
+// Audio thread. Mute is a volume of zero, so it ramps like any other change.
+void AudioEngine::apply(const ControlCommand& command) {
+    switch (command.type) {
+        case ControlCommand::Type::VOLUME:
+            applied_volume_ = command.value;
+            break;
+        case ControlCommand::Type::MUTE:
+            applied_muted_ = command.value != 0.0f;
+            break;
+        case ControlCommand::Type::PITCH:
+            shifter_.set_pitch_ratio(command.value);
+            return;
+    }
+    shifter_.set_volume(applied_muted_ ? 0.0f : applied_volume_);
+}
+
+// Runs the shifter over the block in pieces, applying each queued command
+// at its frame. Commands are taken in queue order; one stamped beyond this
+// block waits, and so does everything queued after it.
+void AudioEngine::process_block(int captured) {
+    const uint64_t end = frames_ + static_cast<uint64_t>(captured);
+    int done = 0;
+    while (ControlCommand* command = controls_.front()) {
+        uint64_t at = std::max(command->frame, frames_ + static_cast<uint64_t>(done));
+        if (at >= end) break;
+        int until = static_cast<int>(at - frames_);
+        if (until > done) {
+            shifter_.process(&input_buffer_[static_cast<size_t>(done) * channels_],
+                             &output_buffer_[static_cast<size_t>(done) * channels_], until - done);
+            done = until;
+        }
+        apply(*command);
+        controls_.pop();
+    }
+    if (done < captured) {
+        shifter_.process(&input_buffer_[static_cast<size_t>(done) * channels_],
+                         &output_buffer_[static_cast<size_t>(done) * channels_], captured - done);
+    }
+}
+
+void AudioEngine::start() {
+    if (running_) return;
+    running_ = true;
+    thread_ready_ = false;
+    thread_ = std::thread(&AudioEngine::run, this);
+    while (!thread_ready_.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+}
+
+void AudioEngine::stop() {
+    running_ = false;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void AudioEngine::run() {
+    LOG_INFO("Audio thread started");
+    TRACE_THREAD("audio");
+    if (realtime_.enabled && realtime_report_) {
+        Realtime::enter_audio_thread(realtime_, *realtime_report_);
+    }
+    thread_ready_.store(true, std::memory_order_release);
+    AllocCheck::watch_thread();
+    int warmup_blocks = 0;
+
+    while (running_.load(std::memory_order_relaxed)) {
+        std::fill(input_buffer_.begin(), input_buffer_.end(), 0.0f);
+        std::fill(output_buffer_.begin(), output_buffer_.end(), 0.0f);
+
+        // Sleep until the device has a period to process
+        bool ready;
+        {
+            TRACE_SCOPE("capture_wait");
+            ready = device_.wait(AUDIO_WAIT_TIMEOUT_MS);
+        }
+        if (!ready) {
+            continue;
+        }
+
+        int captured;
+        {
+            TRACE_SCOPE("capture");
+            captured = device_.capture(input_buffer_.data(), block_frames_);
+        }
+        if (captured <= 0) {
+            continue;
+        }
+
+        auto block_start = std::chrono::steady_clock::now();
+
+        {
+            TRACE_SCOPE("process");
+            process_block(captured);
+        }
+
+        run_loopback(captured);
+
+        // The spectrum only changes on screen ui_fps_ times a second
+        if (frames_ >= spectrum_due_) {
+            shifter_.get_spectrum(spectrum_bands_, spectrum_.data());
+            spectrum_due_ = frames_ + device_.get_sample_rate() / ui_fps_;
+        }
+        frames_ += captured;
+        frame_clock_.store(frames_, std::memory_order_relaxed);
+
+        double block_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - block_start).count();
+        update_perf(block_us, captured);
+
+        {
+            TRACE_SCOPE("playback");
+            device_.playback(output_buffer_.data(), captured);
+        }
+
+        TRACE_SCOPE("publish");
+        float input_level = calculate_db(input_buffer_.data(), captured * channels_);
+        float output_level = calculate_db(output_buffer_.data(), captured * channels_);
+        metrics_.update(captured, block_us * 1e-6, input_level, output_level);
+
+        // Publish stats; drop them if the UI has not caught up
+        AudioStats* stats = stats_queue_.begin_write();
+        if (stats) {
+            stats->input_level = input_level;
+            stats->output_level = output_level;
+            stats->pitch_ratio = shifter_.get_pitch_ratio();
+            stats->pitch_semitones = 0;
+            std::copy(spectrum_.begin(), spectrum_.end(), stats->spectrum.begin());
+            stats->muted = applied_muted_;
+            stats->volume = applied_volume_;
+            fill_perf(stats->perf);
+            stats_queue_.commit_write();
+        }
+
+        if (warmup_blocks < ALLOC_CHECK_WARMUP_BLOCKS && ++warmup_blocks == ALLOC_CHECK_WARMUP_BLOCKS) {
+            AllocCheck::arm();
+        }
+    }
+
+    AllocCheck::unwatch_thread();
+    LOG_INFO("Audio thread stopped");
+}
+
+void AudioEngine::update_perf(double block_us, int frames) {
+    double audio_us = 1e6 * frames / device_.get_sample_rate();
+    window_.record(static_cast<float>(block_us));
+    window_busy_us_ += block_us;
+    window_audio_us_ += audio_us;
+    load_peak_ = std::max(load_peak_, static_cast<float>(100.0 * block_us / audio_us));
+
+    if (window_audio_us_ >= 1e6 * PERF_WINDOW_SECONDS) {
+        previous_window_ = window_;
+        previous_busy_us_ = window_busy_us_;
+        previous_audio_us_ = window_audio_us_;
+        previous_load_peak_ = load_peak_;
+        window_.reset();
+        window_busy_us_ = 0.0;
+        window_audio_us_ = 0.0;
+        load_peak_ = 0.0f;
+    }
+}
+
+// Called with the processed block in output_buffer_, before it is played.
+// Block n's output lines up with input frames [frames_, frames_ + captured).
+void AudioEngine::run_loopback(int captured) {
+    const size_t samples = static_cast<size_t>(captured) * channels_;
+
+    if (loopback_ == LoopbackState::RUNNING) {
+        for (size_t i = 0; i < samples; i++) {
+            if (std::fabs(input_buffer_[i]) > loopback_threshold_) {
+                uint64_t found = frames_ + i / channels_;
+                loopback_ms_ = static_cast<float>(1000.0 * (found - loopback_frame_) / device_.get_sample_rate());
+                loopback_ = LoopbackState::DONE;
+                LOG_INFOF("Loopback round trip: %.2f ms", loopback_ms_);
+                return;
+            }
+        }
+        if (frames_ + captured - loopback_frame_ > LOOPBACK_TIMEOUT_SECONDS * device_.get_sample_rate()) {
+            loopback_ = LoopbackState::FAILED;
+            LOG_INFOF("Loopback test: no impulse heard within %.1f s", LOOPBACK_TIMEOUT_SECONDS);
+        }
+        return;
+    }
+
+    if (!loopback_requested_.exchange(false, std::memory_order_relaxed)) return;
+
+    // Detect well above what the input carries right now
+    float peak = 0.0f;
+    for (size_t i = 0; i < samples; i++) {
+        peak = std::max(peak, std::fabs(input_buffer_[i]));
+    }
+    loopback_threshold_ = std::max(LOOPBACK_MIN_THRESHOLD, LOOPBACK_NOISE_FACTOR * peak);
+
+    size_t impulse = std::min(samples, static_cast<size_t>(LOOPBACK_IMPULSE_FRAMES) * channels_);
+    std::fill(output_buffer_.begin(), output_buffer_.begin() + impulse, LOOPBACK_IMPULSE_LEVEL);
+    loopback_frame_ = frames_;
+    loopback_ = LoopbackState::RUNNING;
+}
+
+void AudioEngine::fill_perf(PerfStats& perf) {
+    LatencyHistogram recent = previous_window_;
+    recent.merge(window_);
+    double busy = previous_busy_us_ + window_busy_us_;
+    double audio = previous_audio_us_ + window_audio_us_;
+
+    perf.block_p50_ms = recent.percentile(50.0f) / 1000.0f;
+    perf.block_p99_ms = recent.percentile(99.0f) / 1000.0f;
+    perf.block_max_ms = recent.max() / 1000.0f;
+    perf.dsp_load = audio > 0.0 ? static_cast<float>(100.0 * busy / audio) : 0.0f;
+    perf.dsp_load_peak = std::max(load_peak_, previous_load_peak_);
+    perf.capture_xruns = device_.capture_xruns();
+    perf.playback_xruns = device_.playback_xruns();
+
+    long delay = device_.delay_frames();
+    perf.pcm_delay_ms = delay >= 0 ? 1000.0f * delay / device_.get_sample_rate() : -1.0f;
+    perf.dsp_latency_ms = 1000.0f * shifter_.latency_samples() / device_.get_sample_rate();
+    perf.engine = shifter_.engine();
+    perf.loopback = loopback_;
+    perf.loopback_ms = loopback_ms_;
+}
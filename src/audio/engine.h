@@ -0,0 +1,152 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "audio/backend.h"
+#include "audio/stats.h"
+#include "dsp/multichannel.h"
+#include "dsp/spectrum_bands.h"
+#include "utils/histogram.h"
+#include "utils/metrics.h"
+#include "utils/mpsc_queue.h"
+#include "utils/realtime.h"
+#include "utils/spsc_queue.h"
+
+// Per-block metrics, shared by the engine and the headless loop
+struct AudioMetrics {
+    AudioMetrics();
+
+    // Call once per processed block
+    void update(int frames, double block_seconds, float input_db, float output_db);
+
+    Counter& blocks;
+    Counter& frames;
+    Histogram& block_seconds;
+    Gauge& input_level_db;
+    Gauge& output_level_db;
+};
+
+// A parameter change for the audio thread. frame is the stream position
+// (frames captured since start, see AudioEngine::frame_clock()) the change
+// lands on; a frame already passed, such as 0, means the next block's start.
+struct ControlCommand {
+    enum class Type {
+        VOLUME,
+        MUTE,
+        PITCH
+    };
+
+    Type type = Type::VOLUME;
+    float value = 0.0f;
+    uint64_t frame = 0;
+};
+
+// Runs capture -> process -> playback on a dedicated thread.
+// Per-block stats are published through a lock-free SPSC queue; when the UI
+// falls behind, stats are dropped rather than blocking the audio path.
+// The engine also times every block and can run a loopback latency test:
+// an impulse is written to the output and searched for in the input, which
+// measures the device round trip when the output is audible to the input
+// (speaker into microphone, or a cable).
+//
+// Volume, mute and pitch reach the audio thread only through a lock-free
+// command queue, from any number of threads. Each block is processed in
+// pieces split at the frames commands are stamped with, and the shifters
+// ramp the change in (see dsp/ramp.h), so there are no block-rate steps.
+class AudioEngine {
+public:
+    AudioEngine(AudioBackend& device, MultiChannelShifter& shifter, int block_frames = BUFFER_FRAMES);
+    ~AudioEngine();
+
+    void start();
+    void stop();
+
+    // Control, safe to call from any thread. False when the command queue
+    // is full and nothing changes; the getters return the last value queued.
+    bool send(const ControlCommand& command);
+    bool set_muted(bool muted, uint64_t at_frame = 0);
+    bool is_muted() const { return muted_.load(std::memory_order_relaxed); }
+    bool set_volume(float vol, uint64_t at_frame = 0);
+    float get_volume() const { return volume_.load(std::memory_order_relaxed); }
+    bool set_pitch_ratio(float ratio, uint64_t at_frame = 0);
+    float get_pitch_ratio() const { return pitch_ratio_.load(std::memory_order_relaxed); }
+    // Frames processed so far, for stamping commands
+    uint64_t frame_clock() const { return frame_clock_.load(std::memory_order_relaxed); }
+    void start_loopback_test() { loopback_requested_.store(true, std::memory_order_relaxed); }
+    void set_shift_engine(ShiftEngine engine) { shifter_.set_engine(engine); }
+    ShiftEngine shift_engine() const { return shifter_.engine(); }
+
+    // Rate the spectrum bands are refreshed at; call before start()
+    void set_ui_fps(int fps) { ui_fps_ = std::max(fps, 1); }
+
+    // Real-time setup of the audio thread; call before start(), which
+    // returns once the thread has recorded what it obtained in *report
+    void set_realtime(const RealtimeConfig& config, RealtimeReport* report) {
+        realtime_ = config;
+        realtime_report_ = report;
+    }
+
+    // Band layout of AudioStats::spectrum
+    const SpectrumBands& spectrum_bands() const { return spectrum_bands_; }
+
+    // Consumer side of the stats channel
+    SPSCQueue<AudioStats>& stats_queue() { return stats_queue_; }
+
+private:
+    void run();
+    void process_block(int captured);
+    void apply(const ControlCommand& command);
+    void update_perf(double block_us, int frames);
+    void run_loopback(int captured);
+    void fill_perf(PerfStats& perf);
+
+    AudioBackend& device_;
+    MultiChannelShifter& shifter_;
+
+    int channels_;
+    int block_frames_;
+    std::thread thread_;
+    std::atomic<bool> running_;
+    std::atomic<bool> muted_;             // last sent
+    std::atomic<float> volume_;
+    std::atomic<float> pitch_ratio_;
+    std::atomic<uint64_t> frame_clock_;
+    MPSCQueue<ControlCommand> controls_;
+
+    std::atomic<bool> loopback_requested_;
+    AudioMetrics metrics_;
+
+    // Audio thread only
+    LatencyHistogram window_;
+    LatencyHistogram previous_window_;
+    double window_busy_us_;
+    double window_audio_us_;
+    double previous_busy_us_;
+    double previous_audio_us_;
+    float load_peak_;
+    float previous_load_peak_;
+    uint64_t frames_;  // captured so far
+    bool applied_muted_;    // as processed, for the stats
+    float applied_volume_;
+
+    // Display bands, recomputed at ui_fps_ and copied into every stats block
+    SpectrumBands spectrum_bands_;
+    std::vector<float> spectrum_;
+    uint64_t spectrum_due_;  // frames_ at which to recompute
+    int ui_fps_;
+
+    RealtimeConfig realtime_;
+    RealtimeReport* realtime_report_;
+    std::atomic<bool> thread_ready_;
+
+    LoopbackState loopback_;
+    uint64_t loopback_frame_;  // input frame the impulse corresponds to
+    float loopback_threshold_;
+    float loopback_ms_;
+
+    std::vector<float> input_buffer_;
+    std::vector<float> output_buffer_;
+    SPSCQueue<AudioStats> stats_queue_;
+};
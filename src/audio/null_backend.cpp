@@ -0,0 +1,51 @@
+#include "audio/null_backend.h"
+#include <algorithm>
+#include <cmath>
+
+NullBackend::NullBackend(int sample_rate, int channels, float tone_hz, size_t total_frames)
+    : sample_rate_(sample_rate), channels_(channels), phase_(0.0),
+      phase_inc_(2.0 * M_PI * tone_hz / sample_rate),
+      total_frames_(total_frames), generated_(0), checksum_(0.0) {
+}
+
+bool NullBackend::open_capture(const char* device_name) {
+    (void)device_name;
+    phase_ = 0.0;
+    generated_ = 0;
+    return true;
+}
+
+bool NullBackend::open_playback(const char* device_name) {
+    (void)device_name;
+    checksum_ = 0.0;
+    return true;
+}
+
+int NullBackend::capture(float* buffer, int frames) {
+    size_t n = static_cast<size_t>(frames);
+    if (total_frames_ > 0) {
+        n = std::min(n, total_frames_ - std::min(generated_, total_frames_));
+    }
+
+    // Fundamental plus two harmonics so every stage sees a non-trivial spectrum
+    for (size_t i = 0; i < n; i++) {
+        for (int c = 0; c < channels_; c++) {
+            double phase = phase_ + c * (M_PI / 8.0);
+            buffer[i * channels_ + c] = static_cast<float>(0.5 * std::sin(phase) +
+                                                           0.2 * std::sin(2.0 * phase) +
+                                                           0.1 * std::sin(3.0 * phase));
+        }
+        phase_ += phase_inc_;
+        if (phase_ > 2.0 * M_PI) phase_ -= 2.0 * M_PI;
+    }
+
+    generated_ += n;
+    return static_cast<int>(n);
+}
+
+int NullBackend::playback(const float* buffer, int frames) {
+    for (int i = 0; i < frames * channels_; i++) {
+        checksum_ += buffer[i];
+    }
+    return frames;
+}
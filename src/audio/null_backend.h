@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include "audio/backend.h"
+
+// Synthetic backend: capture generates a test tone as fast as it is asked
+// for, playback discards the samples. Used to measure DSP throughput
+// without a sound card.
+class NullBackend : public AudioBackend {
+public:
+    // total_frames == 0 generates forever. Each channel gets the same tone
+    // with a growing phase offset, like a source panned across the channels.
+    NullBackend(int sample_rate, int channels = 1, float tone_hz = 440.0f, size_t total_frames = 0);
+
+    bool open_capture(const char* device_name) override;
+    bool open_playback(const char* device_name) override;
+    void close() override {}
+
+    int capture(float* buffer, int frames) override;
+    int playback(const float* buffer, int frames) override;
+
+    int get_sample_rate() const override { return sample_rate_; }
+    int get_channels() const override { return channels_; }
+    bool finished() const override { return total_frames_ > 0 && generated_ >= total_frames_; }
+
+    // Sum of everything played back, keeps the output observable
+    double checksum() const { return checksum_; }
+
+private:
+    int sample_rate_;
+    int channels_;
+    double phase_;
+    double phase_inc_;
+    size_t total_frames_;
+    size_t generated_;
+    double checksum_;
+};
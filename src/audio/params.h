@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include "config.h"
+
+// Sample format requested from ALSA. AUTO takes the first of FLOAT, S32,
+// S24 and S16 that the device accepts.
+enum class SampleFormat {
+    AUTO,
+    FLOAT,
+    S32,
+    S24,
+    S16
+};
+
+// Stream and phase vocoder sizes, chosen at start-up from the command line
+// or a config file. The config.h constants are the defaults.
+struct AudioParams {
+    int sample_rate = SAMPLE_RATE;   // requested from ALSA and the null backend; WAV files use their own
+    size_t fft_size = FFT_SIZE;
+    size_t hop_size = HOP_SIZE;
+    int block_frames = BUFFER_FRAMES;  // frames per capture -> process -> playback pass
+    SampleFormat sample_format = SampleFormat::AUTO;  // ALSA only; others are float or the file's
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "dsp/shifter.h"
+
+enum class LoopbackState {
+    IDLE,
+    RUNNING,
+    DONE,
+    FAILED
+};
+
+// Engine health, measured on the audio thread
+struct PerfStats {
+    float block_p50_ms;     // processing time per block over the last
+    float block_p99_ms;     // one to two PERF_WINDOW_SECONDS
+    float block_max_ms;
+    float dsp_load;         // processing time / audio time, percent
+    float dsp_load_peak;    // worst single block, percent of its deadline
+    uint64_t capture_xruns;
+    uint64_t playback_xruns;
+    float pcm_delay_ms;     // capture + playback snd_pcm_delay, < 0 if unknown
+    float dsp_latency_ms;   // shifter delay (nominal for WSOLA)
+    ShiftEngine engine;
+    LoopbackState loopback;
+    float loopback_ms;      // measured output -> input round trip (DONE only)
+};
+
+struct AudioStats {
+    float input_level;
+    float output_level;
+    float pitch_ratio;
+    int pitch_semitones;
+    std::vector<float> spectrum;  // SPECTRUM_BARS band levels in dB
+    bool muted;
+    float volume;
+    PerfStats perf;
+};
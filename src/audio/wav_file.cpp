@@ -0,0 +1,291 @@
+#include "audio/wav_file.h"
+#include "utils/logger.h"
+#include "config.h"
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    constexpr size_t WAV_HEADER_SIZE = 44;
+    constexpr uint16_t WAVE_FORMAT_PCM = 1;
+    constexpr uint16_t WAVE_FORMAT_IEEE_FLOAT = 3;
+    constexpr uint16_t WAVE_FORMAT_EXTENSIBLE = 0xFFFE;
+    constexpr size_t WAV_RELEASE_BYTES = 8 << 20;
+
+    // Drop the pages before `done` from a mapping once WAV_RELEASE_BYTES have
+    // piled up. The page cache keeps the data (and writes back dirty output
+    // pages), it just stops counting against this process. Returns the new
+    // released offset.
+    size_t release_pages(uint8_t* map, size_t released, size_t done) {
+        static const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t end = done & ~(page - 1);
+        if (end < released + WAV_RELEASE_BYTES) return released;
+        madvise(map + released, end - released, MADV_DONTNEED);
+        return end;
+    }
+
+    uint16_t read_u16(const uint8_t* p) {
+        return static_cast<uint16_t>(p[0] | (p[1] << 8));
+    }
+
+    uint32_t read_u32(const uint8_t* p) {
+        return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+               (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    void write_u16(uint8_t* p, uint16_t v) {
+        p[0] = v & 0xFF;
+        p[1] = (v >> 8) & 0xFF;
+    }
+
+    void write_u32(uint8_t* p, uint32_t v) {
+        for (int i = 0; i < 4; i++) {
+            p[i] = (v >> (8 * i)) & 0xFF;
+        }
+    }
+
+    void write_header(uint8_t* p, int sample_rate, int channels, size_t frames) {
+        uint32_t frame_bytes = static_cast<uint32_t>(channels * sizeof(float));
+        uint32_t data_bytes = static_cast<uint32_t>(frames * frame_bytes);
+        std::memcpy(p, "RIFF", 4);
+        write_u32(p + 4, 36 + data_bytes);
+        std::memcpy(p + 8, "WAVE", 4);
+        std::memcpy(p + 12, "fmt ", 4);
+        write_u32(p + 16, 16);
+        write_u16(p + 20, WAVE_FORMAT_IEEE_FLOAT);
+        write_u16(p + 22, static_cast<uint16_t>(channels));
+        write_u32(p + 24, sample_rate);
+        write_u32(p + 28, sample_rate * frame_bytes);
+        write_u16(p + 32, static_cast<uint16_t>(frame_bytes));
+        write_u16(p + 34, 32);
+        std::memcpy(p + 36, "data", 4);
+        write_u32(p + 40, data_bytes);
+    }
+
+    float read_sample(const uint8_t* p, int bytes, bool is_float) {
+        switch (bytes) {
+            case 2:
+                return static_cast<int16_t>(read_u16(p)) / 32768.0f;
+            case 3: {
+                uint32_t v = (static_cast<uint32_t>(p[0]) << 8) | (static_cast<uint32_t>(p[1]) << 16) |
+                             (static_cast<uint32_t>(p[2]) << 24);
+                return static_cast<int32_t>(v) / 2147483648.0f;
+            }
+            case 4:
+                if (is_float) {
+                    float f;
+                    std::memcpy(&f, p, sizeof(f));
+                    return f;
+                }
+                return static_cast<int32_t>(read_u32(p)) / 2147483648.0f;
+            default:
+                return 0.0f;
+        }
+    }
+}
+
+WavFileBackend::WavFileBackend(int channels) : sample_rate_(SAMPLE_RATE), channels_(channels),
+    in_fd_(-1), in_map_(nullptr), in_map_size_(0), in_data_(nullptr),
+    in_frames_(0), in_pos_(0), in_released_(0), in_bytes_per_sample_(2), in_float_(false),
+    out_fd_(-1), out_map_(nullptr), out_map_size_(0), out_frames_(0), out_released_(0) {
+}
+
+WavFileBackend::~WavFileBackend() {
+    close();
+}
+
+void WavFileBackend::fail(const std::string& message) {
+    LOG_ERROR(message);
+    error_ = message;
+}
+
+bool WavFileBackend::open_capture(const char* path) {
+    in_fd_ = ::open(path, O_RDONLY);
+    if (in_fd_ < 0) {
+        fail(std::string("Cannot open input file '") + path + "': " + std::strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(in_fd_, &st) < 0 || st.st_size < static_cast<off_t>(WAV_HEADER_SIZE)) {
+        fail(std::string("Input file too small: ") + path);
+        close_capture();
+        return false;
+    }
+
+    in_map_size_ = static_cast<size_t>(st.st_size);
+    void* map = mmap(nullptr, in_map_size_, PROT_READ, MAP_PRIVATE, in_fd_, 0);
+    if (map == MAP_FAILED) {
+        fail(std::string("Cannot mmap input file: ") + std::strerror(errno));
+        in_map_ = nullptr;
+        close_capture();
+        return false;
+    }
+    in_map_ = static_cast<uint8_t*>(map);
+    madvise(in_map_, in_map_size_, MADV_SEQUENTIAL);
+
+    if (std::memcmp(in_map_, "RIFF", 4) != 0 || std::memcmp(in_map_ + 8, "WAVE", 4) != 0) {
+        fail(std::string("Not a WAV file: ") + path);
+        close_capture();
+        return false;
+    }
+
+    // Walk the chunk list for "fmt " and "data"
+    bool have_fmt = false;
+    uint16_t format = 0;
+    size_t offset = 12;
+    while (offset + 8 <= in_map_size_) {
+        const uint8_t* chunk = in_map_ + offset;
+        size_t chunk_size = read_u32(chunk + 4);
+        const uint8_t* body = chunk + 8;
+        size_t available = in_map_size_ - (offset + 8);
+
+        if (std::memcmp(chunk, "fmt ", 4) == 0 && chunk_size >= 16) {
+            if (chunk_size > available) break;  // truncated header
+            format = read_u16(body);
+            channels_ = read_u16(body + 2);
+            sample_rate_ = static_cast<int>(read_u32(body + 4));
+            in_bytes_per_sample_ = read_u16(body + 14) / 8;
+            if (format == WAVE_FORMAT_EXTENSIBLE && chunk_size >= 26) {
+                format = read_u16(body + 24);
+            }
+            have_fmt = true;
+        } else if (std::memcmp(chunk, "data", 4) == 0 && have_fmt) {
+            // A short data chunk is read as far as it goes
+            in_data_ = body;
+            size_t frame_bytes = static_cast<size_t>(channels_) * in_bytes_per_sample_;
+            in_frames_ = (frame_bytes > 0) ? std::min(chunk_size, available) / frame_bytes : 0;
+            break;
+        }
+
+        offset += 8 + chunk_size + (chunk_size & 1);
+    }
+
+    in_float_ = (format == WAVE_FORMAT_IEEE_FLOAT);
+    bool supported = (format == WAVE_FORMAT_PCM && in_bytes_per_sample_ >= 2 && in_bytes_per_sample_ <= 4) ||
+                     (in_float_ && in_bytes_per_sample_ == 4);
+    if (!in_data_ || !supported || channels_ < 1) {
+        fail(std::string("Unsupported WAV format: ") + path);
+        close_capture();
+        return false;
+    }
+
+    in_pos_ = 0;
+    in_released_ = 0;
+    LOG_INFO(std::string("Input file '") + path + "': " + std::to_string(in_frames_) + " frames, " +
+             std::to_string(channels_) + " ch, " + std::to_string(sample_rate_) + " Hz");
+    return true;
+}
+
+bool WavFileBackend::open_playback(const char* path) {
+    out_fd_ = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (out_fd_ < 0) {
+        fail(std::string("Cannot open output file '") + path + "': " + std::strerror(errno));
+        return false;
+    }
+
+    out_frames_ = 0;
+    out_released_ = 0;
+    if (!grow_output(WAV_HEADER_SIZE + static_cast<size_t>(sample_rate_) * channels_ * sizeof(float))) {
+        error_ = std::string("Cannot size output file '") + path + "'";
+        close_playback();
+        return false;
+    }
+    return true;
+}
+
+bool WavFileBackend::grow_output(size_t bytes) {
+    size_t new_size = std::max(bytes, out_map_size_ * 2);
+    if (ftruncate(out_fd_, static_cast<off_t>(new_size)) < 0) {
+        LOG_ERRORF("Cannot grow output file: %s", std::strerror(errno));
+        return false;
+    }
+
+    void* map = out_map_
+        ? mremap(out_map_, out_map_size_, new_size, MREMAP_MAYMOVE)
+        : mmap(nullptr, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, out_fd_, 0);
+    if (map == MAP_FAILED) {
+        LOG_ERRORF("Cannot mmap output file: %s", std::strerror(errno));
+        return false;
+    }
+
+    out_map_ = static_cast<uint8_t*>(map);
+    out_map_size_ = new_size;
+    return true;
+}
+
+void WavFileBackend::close_capture() {
+    if (in_map_) {
+        munmap(in_map_, in_map_size_);
+        in_map_ = nullptr;
+    }
+    if (in_fd_ >= 0) {
+        ::close(in_fd_);
+        in_fd_ = -1;
+    }
+    in_data_ = nullptr;
+    in_map_size_ = 0;
+}
+
+void WavFileBackend::close_playback() {
+    size_t file_size = WAV_HEADER_SIZE + out_frames_ * channels_ * sizeof(float);
+    if (out_map_) {
+        write_header(out_map_, sample_rate_, channels_, out_frames_);
+        munmap(out_map_, out_map_size_);
+        out_map_ = nullptr;
+    }
+    if (out_fd_ >= 0) {
+        if (ftruncate(out_fd_, static_cast<off_t>(file_size)) < 0) {
+            LOG_ERROR(std::string("Cannot finalise output file: ") + std::strerror(errno));
+        }
+        ::close(out_fd_);
+        out_fd_ = -1;
+    }
+    out_map_size_ = 0;
+}
+
+void WavFileBackend::close() {
+    close_capture();
+    close_playback();
+}
+
+int WavFileBackend::capture(float* buffer, int frames) {
+    if (!in_data_ || in_pos_ >= in_frames_) return 0;
+
+    size_t n = std::min(static_cast<size_t>(frames), in_frames_ - in_pos_);
+    size_t frame_bytes = static_cast<size_t>(channels_) * in_bytes_per_sample_;
+    const uint8_t* p = in_data_ + in_pos_ * frame_bytes;
+
+    if (in_float_) {
+        std::memcpy(buffer, p, n * frame_bytes);
+    } else {
+        for (size_t i = 0; i < n * channels_; i++) {
+            buffer[i] = read_sample(p, in_bytes_per_sample_, false);
+            p += in_bytes_per_sample_;
+        }
+    }
+
+    in_pos_ += n;
+    in_released_ = release_pages(in_map_, in_released_,
+                                 static_cast<size_t>(in_data_ - in_map_) + in_pos_ * frame_bytes);
+    return static_cast<int>(n);
+}
+
+int WavFileBackend::playback(const float* buffer, int frames) {
+    if (!out_map_ || frames <= 0) return 0;
+
+    size_t frame_bytes = channels_ * sizeof(float);
+    size_t needed = WAV_HEADER_SIZE + (out_frames_ + frames) * frame_bytes;
+    if (needed > out_map_size_ && !grow_output(needed)) {
+        return 0;
+    }
+
+    std::memcpy(out_map_ + WAV_HEADER_SIZE + out_frames_ * frame_bytes, buffer, frames * frame_bytes);
+    out_frames_ += frames;
+    out_released_ = release_pages(out_map_, out_released_, WAV_HEADER_SIZE + out_frames_ * frame_bytes);
+    return frames;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include "audio/backend.h"
+
+// WAV file source/sink, streamed through mmap.
+// Capture reads 16/24/32-bit PCM or 32-bit float files with any channel
+// count; playback writes a 32-bit float file with the same channel count
+// (or the one given to the constructor when there is no input), growing
+// the mapping as needed. The header is finalised on close(). Pages that have
+// been streamed through are dropped from the mapping every few MB, so resident
+// memory stays bounded however long the file is.
+class WavFileBackend : public AudioBackend {
+public:
+    explicit WavFileBackend(int channels = 1);
+    ~WavFileBackend() override;
+
+    bool open_capture(const char* path) override;
+    bool open_playback(const char* path) override;
+    void close() override;
+
+    int capture(float* buffer, int frames) override;
+    int playback(const float* buffer, int frames) override;
+
+    int get_sample_rate() const override { return sample_rate_; }
+    int get_channels() const override { return channels_; }
+    bool finished() const override { return in_map_ && in_pos_ >= in_frames_; }
+
+    size_t total_frames() const { return in_frames_; }
+
+    // Why the last open_capture()/open_playback() failed (also logged)
+    const std::string& error() const { return error_; }
+
+private:
+    void fail(const std::string& message);
+    bool grow_output(size_t bytes);
+    void close_capture();
+    void close_playback();
+
+    int sample_rate_;
+    int channels_;
+    std::string error_;
+
+    // Source
+    int in_fd_;
+    uint8_t* in_map_;
+    size_t in_map_size_;
+    const uint8_t* in_data_;
+    size_t in_frames_;
+    size_t in_pos_;
+    size_t in_released_;  // bytes of the mapping already dropped
+    int in_bytes_per_sample_;
+    bool in_float_;
+
+    // Sink
+    int out_fd_;
+    uint8_t* out_map_;
+    size_t out_map_size_;
+    size_t out_frames_;
+    size_t out_released_;
+};
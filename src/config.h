@@ -1,11 +1,27 @@
 #ifndef VOCODER_CONFIG_H
 #define VOCODER_CONFIG_H
 
-// Audio
+#include <cstddef>
+
+// Audio defaults; overridden at run time through AudioParams (audio/params.h)
 constexpr int SAMPLE_RATE = 44100;
 constexpr int FFT_SIZE = 4096;
 constexpr int HOP_SIZE = 1024;
 constexpr int BUFFER_FRAMES = 1024;
+constexpr int MIN_SAMPLE_RATE = 8000;
+constexpr int MAX_SAMPLE_RATE = 192000;
+constexpr size_t MIN_FFT_SIZE = 256;
+constexpr size_t MAX_FFT_SIZE = 65536;
+constexpr int MAX_BLOCK_FRAMES = 16384;
+constexpr size_t SHIFT_CHUNK_FRAMES = 1024;  // frames MultiChannelShifter processes per step
+constexpr size_t PIPELINE_QUEUE_FRAMES = 4;   // analysed frames / finished hops in flight (--pipeline)
+constexpr size_t GAIN_RAMP_FRAMES = 256;      // volume and mute changes ramp over this many samples
+constexpr size_t PITCH_GLIDE_FRAMES = 2048;   // pitch changes glide over this (whole hops for the STFT)
+constexpr size_t CONTROL_QUEUE_SIZE = 64;     // pending control commands for the audio thread
+constexpr int DEFAULT_CHANNELS = 1;
+constexpr int MAX_CHANNELS = 8;
+constexpr int AUDIO_WAIT_TIMEOUT_MS = 100;    // poll() timeout, so stop requests are seen
+constexpr size_t PARALLEL_MIN_FFT_SIZE = 2048;  // smaller FFTs are not worth a thread hand-off
 constexpr float SPECTRUM_MIN_DB = -35.0f;
 constexpr float SPECTRUM_MAX_DB = 0.0f;
 constexpr int SPECTRUM_BARS = 32;
@@ -13,6 +29,18 @@ constexpr int SPECTRUM_HEIGHT = 10;
 constexpr float SPECTRUM_MIN_FREQ = 20.0f;
 constexpr float SPECTRUM_MAX_FREQ = 20000.0f;
 
+// Low-latency time-domain shifter (--engine wsola)
+constexpr size_t WSOLA_OVERLAP = 64;    // splice crossfade and waveform match length
+constexpr size_t WSOLA_SEARCH = 128;    // +- offsets tried around each jump
+constexpr size_t WSOLA_JUMP = 384;      // nominal read-head jump per splice
+
+// Clock-drift compensation between unlinked ALSA streams (audio/drift.h)
+constexpr double DRIFT_MAX_PPM = 2000.0;   // limit of the resampling ratio correction
+constexpr double DRIFT_KP = 4e-6;          // ratio per frame of delay error
+constexpr double DRIFT_KI = 4e-12;         // ratio per frame of error per frame elapsed (critically damped)
+constexpr double DRIFT_SMOOTHING = 0.05;   // weight of each block's delay measurement
+constexpr int DRIFT_SETTLE_BLOCKS = 100;   // blocks before the target delay is taken
+
 // Level meters
 constexpr int METER_WIDTH = 20;
 constexpr float METER_MIN_DB = -60.0f;
@@ -23,7 +51,49 @@ constexpr float METER_RED_DB = -3.0f;
 // Master meter
 constexpr int MASTER_HEIGHT = 10;
 
+// Latency calibration (--calibrate)
+constexpr unsigned long CALIBRATE_MAX_PERIOD = 2048;
+constexpr unsigned long CALIBRATE_MIN_PERIOD = 32;
+constexpr unsigned int CALIBRATE_PERIODS = 2;    // period count unless --periods is given
+constexpr double CALIBRATE_SECONDS = 3.0;        // per period size
+constexpr double CALIBRATE_WARMUP_SECONDS = 0.25; // start-up xruns are ignored
+constexpr unsigned long CALIBRATE_MARGIN = 2;    // safety factor on the smallest stable period
+
 // TUI
 constexpr float SMOOTHING_FACTOR = 0.3f;  // for level meter smoothing
+constexpr int UI_FPS = 30;                // redraw cap, independent of the audio block rate
+
+// Audio thread -> UI
+constexpr int STATS_QUEUE_SIZE = 8;       // blocks of stats buffered for the UI
+constexpr double PERF_WINDOW_SECONDS = 2.0;  // block-time percentiles cover the last 1-2 windows
+
+// Loopback latency test (impulse injected into the output, found in the input)
+constexpr int LOOPBACK_IMPULSE_FRAMES = 32;
+constexpr float LOOPBACK_IMPULSE_LEVEL = 0.8f;
+constexpr float LOOPBACK_MIN_THRESHOLD = 0.05f;  // absolute floor for detection
+constexpr float LOOPBACK_NOISE_FACTOR = 4.0f;    // detection threshold over the pre-test input peak
+constexpr double LOOPBACK_TIMEOUT_SECONDS = 1.0;
+
+// Metrics export (--metrics)
+constexpr int METRICS_FILE_INTERVAL_MS = 1000;  // file rewrite interval / socket poll timeout
+
+// Tracing (built with -DVOCODER_TRACE=ON, dumped with --trace)
+constexpr size_t TRACE_RING_EVENTS = 16384;      // per thread, a few seconds of audio blocks
+constexpr double TRACE_DUMP_SECONDS = 5.0;       // window written per dump
+constexpr double TRACE_DUMP_HOLDOFF_SECONDS = 10.0;  // xrun bursts produce one dump
+constexpr int TRACE_POLL_MS = 100;               // dump thread wake-up interval
+
+// Real-time mode (--realtime)
+constexpr int REALTIME_PRIORITY = 70;            // SCHED_FIFO priority of the audio and DSP threads
+constexpr size_t REALTIME_STACK_PREFAULT = 256 * 1024;  // stack touched up front per thread
+
+// Allocation check (built with -DVOCODER_ALLOC_CHECK=ON)
+constexpr int ALLOC_CHECK_WARMUP_BLOCKS = 32;    // allocations before this are start-up
+constexpr int ALLOC_CHECK_STACK_DEPTH = 32;      // frames kept of the first offender
+
+// Logging
+constexpr int LOG_QUEUE_SIZE = 1024;      // records buffered for the writer thread
+constexpr int LOG_MESSAGE_SIZE = 240;     // longer messages are truncated
+constexpr int LOG_FLUSH_MS = 50;          // writer wake-up interval
 
 #endif
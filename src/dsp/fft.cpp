@@ -1,48 +1,281 @@
 #include "dsp/fft.h"
+#include "utils/fs.h"
+#include "utils/logger.h"
+#include "utils/trace.h"
 #include <fftw3.h>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+    constexpr double WISDOM_TIMELIMIT = 10.0;  // seconds per background plan
+
+    // FFTW's planner is not thread-safe; every plan create/destroy and all
+    // wisdom I/O go through this mutex. Background planning happens in a
+    // forked child, so the mutex is only held to fork and to import the
+    // result. On exit unfinished children are killed and their threads
+    // joined, before the mutex goes away.
+    struct Planner {
+        std::mutex mutex;
+        FFTPlanEffort effort = FFTPlanEffort::ESTIMATE;
+        std::string wisdom_dir;
+        std::set<size_t> loaded;
+        std::set<size_t> scheduled;
+        std::set<pid_t> children;
+        bool stopping = false;
+        std::vector<std::thread> workers;
+
+        ~Planner() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+                for (pid_t child : children) kill(child, SIGKILL);
+            }
+            for (auto& worker : workers) {
+                if (worker.joinable()) worker.join();
+            }
+        }
+    };
+
+    Planner& planner() {
+        static Planner instance;
+        return instance;
+    }
+
+    unsigned effort_flags(FFTPlanEffort effort) {
+        switch (effort) {
+            case FFTPlanEffort::MEASURE:    return FFTW_MEASURE;
+            case FFTPlanEffort::PATIENT:    return FFTW_PATIENT;
+            case FFTPlanEffort::EXHAUSTIVE: return FFTW_EXHAUSTIVE;
+            case FFTPlanEffort::ESTIMATE:
+            default:                        return FFTW_ESTIMATE;
+        }
+    }
+
+    const char* effort_name(FFTPlanEffort effort) {
+        switch (effort) {
+            case FFTPlanEffort::MEASURE:    return "measure";
+            case FFTPlanEffort::PATIENT:    return "patient";
+            case FFTPlanEffort::EXHAUSTIVE: return "exhaustive";
+            case FFTPlanEffort::ESTIMATE:
+            default:                        return "estimate";
+        }
+    }
+
+    // CPU model from /proc/cpuinfo, reduced to a file-name-safe key
+    const std::string& cpu_key() {
+        static const std::string key = [] {
+            std::ifstream cpuinfo("/proc/cpuinfo");
+            std::string line;
+            std::string model = "generic";
+            while (std::getline(cpuinfo, line)) {
+                if (line.compare(0, 10, "model name") == 0) {
+                    size_t colon = line.find(':');
+                    if (colon != std::string::npos) model = line.substr(colon + 1);
+                    break;
+                }
+            }
+            std::string safe;
+            for (char c : model) {
+                if (std::isalnum(static_cast<unsigned char>(c))) {
+                    safe += c;
+                } else if (!safe.empty() && safe.back() != '-') {
+                    safe += '-';
+                }
+            }
+            while (!safe.empty() && safe.back() == '-') safe.pop_back();
+            return safe.empty() ? std::string("generic") : safe;
+        }();
+        return key;
+    }
+
+    std::string wisdom_path(const Planner& p, size_t fft_size) {
+        return p.wisdom_dir + "/fftwf-" + cpu_key() + "-" + effort_name(p.effort) + "-" +
+               std::to_string(fft_size) + ".wisdom";
+    }
+
+    // Forked child: plan with the given effort and save the wisdom. Only
+    // FFTW and plain file calls here; the parent's other threads are gone,
+    // so both paths are built by the parent before fork().
+    [[noreturn]] void plan_in_child(size_t fft_size, unsigned flags, const char* path, const char* tmp) {
+        int n = static_cast<int>(fft_size);
+        float* real = fftwf_alloc_real(fft_size);
+        fftwf_complex* complex = fftwf_alloc_complex(fft_size / 2 + 1);
+
+        fftwf_set_timelimit(WISDOM_TIMELIMIT);
+        fftwf_plan forward = fftwf_plan_dft_r2c_1d(n, real, complex, flags);
+        fftwf_plan inverse = fftwf_plan_dft_c2r_1d(n, complex, real, flags);
+
+        // Write to a temporary file and rename so readers never see a partial file
+        bool saved = forward && inverse && fftwf_export_wisdom_to_filename(tmp) &&
+                     std::rename(tmp, path) == 0;
+        _exit(saved ? 0 : 1);
+    }
+
+    // Background thread: runs the planner in a child process, so the
+    // process-wide planner lock is free for FFTProcessors in the meantime,
+    // then imports the saved wisdom
+    void plan_wisdom(size_t fft_size) {
+        Planner& p = planner();
+        std::string path;
+        std::string tmp;
+        pid_t child;
+        {
+            // Fork under the lock, so the child's FFTW state is consistent
+            std::lock_guard<std::mutex> lock(p.mutex);
+            if (p.stopping) return;
+            make_dirs(p.wisdom_dir);
+            path = wisdom_path(p, fft_size);
+            tmp = path + ".tmp";
+            unsigned flags = effort_flags(p.effort);
+            child = fork();
+            if (child == 0) plan_in_child(fft_size, flags, path.c_str(), tmp.c_str());
+            if (child > 0) p.children.insert(child);
+        }
+        if (child < 0) {
+            LOG_ERROR("FFT " + std::to_string(fft_size) + ": cannot start background planning");
+            return;
+        }
+
+        int status = 0;
+        while (waitpid(child, &status, 0) < 0 && errno == EINTR) {}
+
+        std::lock_guard<std::mutex> lock(p.mutex);
+        p.children.erase(child);
+        if (p.stopping) return;
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+            fftwf_import_wisdom_from_filename(path.c_str())) {
+            LOG_INFO("FFT " + std::to_string(fft_size) + ": saved wisdom to " + path);
+        } else {
+            LOG_ERROR("FFT " + std::to_string(fft_size) + ": cannot save wisdom to " + path);
+        }
+    }
+}
+
+void FFTProcessor::configure_planning(FFTPlanEffort effort, const std::string& wisdom_dir) {
+    Planner& p = planner();
+    std::lock_guard<std::mutex> lock(p.mutex);
+    p.effort = effort;
+    p.wisdom_dir = wisdom_dir;
+    p.loaded.clear();
+}
+
+std::string FFTProcessor::default_wisdom_dir() {
+    if (const char* cache = std::getenv("XDG_CACHE_HOME")) {
+        if (*cache) return std::string(cache) + "/vocoder-tui";
+    }
+    if (const char* home = std::getenv("HOME")) {
+        if (*home) return std::string(home) + "/.cache/vocoder-tui";
+    }
+    return "/tmp/vocoder-tui";
+}
+
+bool FFTProcessor::parse_effort(const std::string& name, FFTPlanEffort& effort) {
+    for (FFTPlanEffort e : {FFTPlanEffort::ESTIMATE, FFTPlanEffort::MEASURE,
+                            FFTPlanEffort::PATIENT, FFTPlanEffort::EXHAUSTIVE}) {
+        if (name == effort_name(e)) {
+            effort = e;
+            return true;
+        }
+    }
+    return false;
+}
 
 FFTProcessor::FFTProcessor(size_t fft_size) : fft_size_(fft_size),
     plan_forward_(nullptr), plan_inverse_(nullptr),
-    input_buffer_(fftwf_alloc_real(fft_size)),
-    output_buffer_(fftwf_alloc_real(fft_size)),
+    time_buffer_(fftwf_alloc_real(fft_size)),
     complex_buffer_(fftwf_alloc_complex(fft_size / 2 + 1)) {
-    
+
+    Planner& p = planner();
+    std::lock_guard<std::mutex> lock(p.mutex);
+
+    bool tuned = p.effort != FFTPlanEffort::ESTIMATE && !p.wisdom_dir.empty();
+    if (tuned) {
+        if (p.loaded.insert(fft_size_).second) {
+            fftwf_import_wisdom_from_filename(wisdom_path(p, fft_size_).c_str());
+        }
+
+        // Only use existing wisdom; never measure on the caller's thread
+        unsigned flags = effort_flags(p.effort) | FFTW_WISDOM_ONLY;
+        plan_forward_ = fftwf_plan_dft_r2c_1d(
+            static_cast<int>(fft_size_), time_buffer_, complex_buffer_, flags);
+        plan_inverse_ = fftwf_plan_dft_c2r_1d(
+            static_cast<int>(fft_size_), complex_buffer_, time_buffer_, flags);
+
+        if (plan_forward_ && plan_inverse_) {
+            LOG_INFO("FFT " + std::to_string(fft_size_) + ": using " + effort_name(p.effort) + " wisdom");
+            return;
+        }
+
+        if (plan_forward_) fftwf_destroy_plan(static_cast<fftwf_plan>(plan_forward_));
+        if (plan_inverse_) fftwf_destroy_plan(static_cast<fftwf_plan>(plan_inverse_));
+
+        if (p.scheduled.insert(fft_size_).second) {
+            LOG_INFO("FFT " + std::to_string(fft_size_) + ": no " + effort_name(p.effort) +
+                     " wisdom, planning in background");
+            p.workers.emplace_back(plan_wisdom, fft_size_);
+        }
+    }
+
     plan_forward_ = fftwf_plan_dft_r2c_1d(
         static_cast<int>(fft_size_), 
-        input_buffer_, 
+        time_buffer_, 
         complex_buffer_, 
         FFTW_ESTIMATE);
     
     plan_inverse_ = fftwf_plan_dft_c2r_1d(
         static_cast<int>(fft_size_), 
         complex_buffer_, 
-        output_buffer_, 
+        time_buffer_, 
         FFTW_ESTIMATE);
 }
 
 FFTProcessor::~FFTProcessor() {
+    std::lock_guard<std::mutex> lock(planner().mutex);
     if (plan_forward_) {
         fftwf_destroy_plan(static_cast<fftwf_plan>(plan_forward_));
     }
     if (plan_inverse_) {
         fftwf_destroy_plan(static_cast<fftwf_plan>(plan_inverse_));
     }
-    if (input_buffer_) {
-        fftwf_free(input_buffer_);
-    }
-    if (output_buffer_) {
-        fftwf_free(output_buffer_);
+    if (time_buffer_) {
+        fftwf_free(time_buffer_);
     }
     if (complex_buffer_) {
         fftwf_free(complex_buffer_);
     }
 }
 
+size_t FFTProcessor::prefault() {
+    std::memset(time_buffer_, 0, fft_size_ * sizeof(float));
+    std::memset(complex_buffer_, 0, bins() * sizeof(fftwf_complex));
+    return fft_size_ * sizeof(float) + bins() * sizeof(fftwf_complex);
+}
+
+void FFTProcessor::execute_forward() {
+    TRACE_SCOPE("fft");
+    fftwf_execute(static_cast<fftwf_plan>(plan_forward_));
+}
+
+void FFTProcessor::execute_inverse() {
+    TRACE_SCOPE("ifft");
+    fftwf_execute(static_cast<fftwf_plan>(plan_inverse_));
+}
+
 void FFTProcessor::forward(const float* input, float* real_out, float* imag_out) {
-    std::memcpy(input_buffer_, input, fft_size_ * sizeof(float));
+    std::memcpy(time_buffer_, input, fft_size_ * sizeof(float));
     
-    fftwf_execute(static_cast<fftwf_plan>(plan_forward_));
+    execute_forward();
     
     for (size_t i = 0; i < fft_size_ / 2 + 1; i++) {
         real_out[i] = complex_buffer_[i][0];
@@ -56,9 +289,9 @@ void FFTProcessor::inverse(const float* real_in, const float* imag_in, float* ou
         complex_buffer_[i][1] = imag_in[i];
     }
     
-    fftwf_execute(static_cast<fftwf_plan>(plan_inverse_));
+    execute_inverse();
     
     for (size_t i = 0; i < fft_size_; i++) {
-        output[i] = output_buffer_[i] / static_cast<float>(fft_size_);
+        output[i] = time_buffer_[i] / static_cast<float>(fft_size_);
     }
 }
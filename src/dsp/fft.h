@@ -1,8 +1,16 @@
 #pragma once
 
 #include <cstddef>
+#include <string>
 #include <fftw3.h>
 
+enum class FFTPlanEffort {
+    ESTIMATE,
+    MEASURE,
+    PATIENT,
+    EXHAUSTIVE
+};
+
 class FFTProcessor {
 public:
     FFTProcessor(size_t fft_size);
@@ -11,13 +19,36 @@ public:
     void forward(const float* input, float* real_out, float* imag_out);
     void inverse(const float* real_in, const float* imag_in, float* output);
 
+    // Zero-copy interface on the FFTW-aligned buffers. Fill time_buffer(),
+    // execute_forward(), read spectrum(); or fill spectrum(), execute_inverse(),
+    // read time_buffer(). The inverse is unnormalised (scaled by size()), so
+    // callers fold 1/size() into their own output pass. execute_inverse()
+    // overwrites spectrum().
+    float* time_buffer() { return time_buffer_; }
+    fftwf_complex* spectrum() { return complex_buffer_; }
+    void execute_forward();
+    void execute_inverse();
+
+    // Write every page of the FFTW buffers, so they are resident before the
+    // first transform; returns the bytes touched
+    size_t prefault();
+
     size_t size() const { return fft_size_; }
+    size_t bins() const { return fft_size_ / 2 + 1; }
+
+    // Process-wide planner settings, call once before creating processors.
+    // With an effort above ESTIMATE, plans come from the on-disk wisdom in
+    // wisdom_dir (one file per FFT size and CPU). Missing wisdom is planned
+    // in a background child process and saved for the next launch, while
+    // this run falls back to FFTW_ESTIMATE plans.
+    static void configure_planning(FFTPlanEffort effort, const std::string& wisdom_dir);
+    static std::string default_wisdom_dir();
+    static bool parse_effort(const std::string& name, FFTPlanEffort& effort);
 
 private:
     size_t fft_size_;
     void* plan_forward_;
     void* plan_inverse_;
-    float* input_buffer_;
-    float* output_buffer_;
+    float* time_buffer_;
     fftwf_complex* complex_buffer_;
 };
@@ -0,0 +1,248 @@
+#include "dsp/multichannel.h"
+#include "dsp/simd.h"
+#include "utils/alloc_check.h"
+#include "utils/logger.h"
+#include "utils/realtime.h"
+#include "utils/trace.h"
+#include "config.h"
+#include <algorithm>
+
+MultiChannelShifter::MultiChannelShifter(size_t channels, size_t fft_size, size_t hop_size,
+                                         int sample_rate, bool phase_lock, size_t max_threads)
+    : engine_(ShiftEngine::STFT), requested_engine_(ShiftEngine::STFT),
+      in_planes_(channels, std::vector<float>(SHIFT_CHUNK_FRAMES)),
+      out_planes_(channels, std::vector<float>(SHIFT_CHUNK_FRAMES)),
+      phase_lock_(phase_lock && channels > 1),
+      hop_fill_(0),
+      stopping_(false),
+      job_first_channel_(0), job_offset_(0), job_frames_(0),
+      pending_(0), worker_priority_(0), worker_error_(0) {
+
+    channels = std::max<size_t>(channels, 1);
+    for (size_t c = 0; c < channels; c++) {
+        stft_.push_back(std::make_unique<PitchShifter>(fft_size, hop_size, sample_rate));
+        wsola_.push_back(std::make_unique<WsolaShifter>(fft_size));
+        shifters_.push_back(stft_[c].get());
+        in_ptrs_.push_back(in_planes_[c].data());
+        out_ptrs_.push_back(out_planes_[c].data());
+    }
+
+    if (phase_lock_) {
+        for (size_t c = 1; c < channels; c++) {
+            stft_[c]->set_phase_reference(stft_[0].get());
+            wsola_[c]->set_reference(wsola_[0].get());
+        }
+    }
+
+    // Small FFTs finish faster than a thread hand-off
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    size_t threads = std::min(channels, max_threads > 0 ? max_threads : cores);
+    if (fft_size >= PARALLEL_MIN_FFT_SIZE && threads > 1) {
+        // All semaphores first: workers index wakes_ as soon as they start
+        for (size_t slot = 1; slot < threads; slot++) {
+            wakes_.push_back(std::make_unique<Semaphore>());
+        }
+        for (size_t slot = 1; slot < threads; slot++) {
+            workers_.emplace_back(&MultiChannelShifter::worker_loop, this, slot);
+        }
+    }
+}
+
+MultiChannelShifter::~MultiChannelShifter() {
+    stopping_.store(true, std::memory_order_release);
+    for (auto& wake : wakes_) wake->post();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+bool MultiChannelShifter::parse_engine(const std::string& name, ShiftEngine& engine) {
+    for (ShiftEngine e : {ShiftEngine::STFT, ShiftEngine::WSOLA}) {
+        if (name == engine_name(e)) {
+            engine = e;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* MultiChannelShifter::engine_name(ShiftEngine engine) {
+    return engine == ShiftEngine::WSOLA ? "wsola" : "stft";
+}
+
+// Both engines get every parameter change, so a switch needs no hand-over
+void MultiChannelShifter::set_pitch_ratio(float ratio) {
+    for (auto& shifter : stft_) shifter->set_pitch_ratio(ratio);
+    for (auto& shifter : wsola_) shifter->set_pitch_ratio(ratio);
+}
+
+void MultiChannelShifter::set_volume(float vol) {
+    for (auto& shifter : stft_) shifter->set_volume(vol);
+    for (auto& shifter : wsola_) shifter->set_volume(vol);
+}
+
+void MultiChannelShifter::reset() {
+    for (Shifter* shifter : shifters_) shifter->reset();
+    hop_fill_ = 0;
+}
+
+size_t MultiChannelShifter::prefault() {
+    size_t bytes = 0;
+    for (auto& shifter : stft_) bytes += shifter->prefault();
+    for (auto& shifter : wsola_) bytes += shifter->prefault();
+    for (size_t c = 0; c < in_planes_.size(); c++) {
+        std::fill(in_planes_[c].begin(), in_planes_[c].end(), 0.0f);
+        std::fill(out_planes_[c].begin(), out_planes_[c].end(), 0.0f);
+        bytes += (in_planes_[c].size() + out_planes_[c].size()) * sizeof(float);
+    }
+    hop_fill_ = 0;
+    return bytes;
+}
+
+bool MultiChannelShifter::set_pipelined(bool pipelined) {
+    if (pipelined && phase_lock_) {
+        LOG_ERROR("Pipelined STFT is not available with phase locking");
+        return false;
+    }
+    for (auto& shifter : stft_) shifter->set_pipelined(pipelined);
+    return true;
+}
+
+int MultiChannelShifter::set_worker_realtime(int priority) {
+    worker_priority_.store(priority, std::memory_order_relaxed);
+    int error = 0;
+    for (auto& shifter : stft_) {
+        int refused = shifter->set_thread_priority(priority);
+        if (error == 0) error = refused;
+    }
+    if (workers_.empty()) return error;
+
+    // An empty job, so every worker applies it now
+    dispatch(shifters_.size(), 0, 0);
+    while (pending_.load(std::memory_order_acquire) != 0) {
+        std::this_thread::yield();
+    }
+    return error != 0 ? error : worker_error_.load(std::memory_order_relaxed);
+}
+
+size_t MultiChannelShifter::latency_samples() const {
+    return engine() == ShiftEngine::WSOLA ? wsola_[0]->latency_samples() : stft_[0]->latency_samples();
+}
+
+void MultiChannelShifter::get_spectrum(const SpectrumBands& bands, float* band_db) {
+    shifters_[0]->get_spectrum(bands, band_db);
+}
+
+// The newly active engine restarts from silence, so a switch drops about
+// its latency's worth of audio
+void MultiChannelShifter::apply_engine() {
+    ShiftEngine requested = requested_engine_.load(std::memory_order_relaxed);
+    if (requested == engine_) return;
+    engine_ = requested;
+    for (size_t c = 0; c < shifters_.size(); c++) {
+        shifters_[c] = engine_ == ShiftEngine::WSOLA ? static_cast<Shifter*>(wsola_[c].get())
+                                                     : static_cast<Shifter*>(stft_[c].get());
+    }
+    reset();
+}
+
+void MultiChannelShifter::process(const float* input, float* output, int num_frames) {
+    apply_engine();
+    const size_t channels = shifters_.size();
+    const size_t hop = shifters_[0]->hop_size();
+
+    size_t done = 0;
+    while (done < static_cast<size_t>(num_frames)) {
+        size_t chunk = std::min(static_cast<size_t>(num_frames) - done, SHIFT_CHUNK_FRAMES);
+
+        if (channels == 1) {
+            shifters_[0]->process(input + done, output + done, static_cast<int>(chunk));
+            done += chunk;
+            continue;
+        }
+
+        for (size_t c = 0; c < channels; c++) {
+            in_ptrs_[c] = in_planes_[c].data();
+        }
+        simd::deinterleave(input + done * channels, in_ptrs_.data(), channels, chunk);
+
+        if (!phase_lock_) {
+            process_planes(0, 0, chunk);
+        } else {
+            // Split at hop boundaries so channel 0 finishes each frame first
+            for (size_t offset = 0; offset < chunk; ) {
+                size_t n = std::min(hop - hop_fill_, chunk - offset);
+                shifters_[0]->process(in_ptrs_[0] + offset, out_ptrs_[0] + offset, static_cast<int>(n));
+                process_planes(1, offset, n);
+                hop_fill_ = (hop_fill_ + n) % hop;
+                offset += n;
+            }
+        }
+
+        simd::interleave(out_ptrs_.data(), output + done * channels, channels, chunk);
+        done += chunk;
+    }
+}
+
+void MultiChannelShifter::process_planes(size_t first_channel, size_t offset, size_t frames) {
+    if (workers_.empty() || engine_ == ShiftEngine::WSOLA) {
+        for (size_t c = first_channel; c < shifters_.size(); c++) {
+            shifters_[c]->process(in_ptrs_[c] + offset, out_ptrs_[c] + offset, static_cast<int>(frames));
+        }
+        return;
+    }
+
+    dispatch(first_channel, offset, frames);
+    process_channels(0, first_channel, offset, frames);
+
+    while (pending_.load(std::memory_order_acquire) != 0) {
+        std::this_thread::yield();
+    }
+}
+
+// Never blocks: the previous job has drained (pending_ is 0), and a post is
+// an atomic increment plus a futex wake only for a sleeping worker
+void MultiChannelShifter::dispatch(size_t first_channel, size_t offset, size_t frames) {
+    job_first_channel_ = first_channel;
+    job_offset_ = offset;
+    job_frames_ = frames;
+    pending_.store(workers_.size(), std::memory_order_relaxed);
+    for (auto& wake : wakes_) wake->post();
+}
+
+// Channels are dealt round-robin over the slots
+void MultiChannelShifter::process_channels(size_t slot, size_t first_channel, size_t offset, size_t frames) {
+    const size_t slots = workers_.size() + 1;
+    for (size_t c = first_channel + slot; c < shifters_.size(); c += slots) {
+        shifters_[c]->process(in_ptrs_[c] + offset, out_ptrs_[c] + offset, static_cast<int>(frames));
+    }
+}
+
+void MultiChannelShifter::worker_loop(size_t slot) {
+    TRACE_THREAD("dsp-worker");
+    AllocCheck::watch_thread();
+    Semaphore& wake = *wakes_[slot - 1];
+    int priority = 0;
+    for (;;) {
+        wake.wait();
+        if (stopping_.load(std::memory_order_acquire)) return;
+        const size_t first_channel = job_first_channel_;
+        const size_t offset = job_offset_;
+        const size_t frames = job_frames_;
+
+        int requested = worker_priority_.load(std::memory_order_relaxed);
+        if (requested > 0 && requested != priority) {
+            priority = requested;
+            Realtime::disable_denormals();
+            Realtime::prefault_stack();
+            int error = Realtime::set_fifo(priority);
+            if (error != 0) {
+                int none = 0;
+                worker_error_.compare_exchange_strong(none, error, std::memory_order_relaxed);
+            }
+        }
+
+        process_channels(slot, first_channel, offset, frames);
+        pending_.fetch_sub(1, std::memory_order_release);
+    }
+}
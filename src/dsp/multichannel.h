@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <string>
+#include "dsp/pitchshift.h"
+#include "dsp/wsola.h"
+#include "utils/semaphore.h"
+
+// One shifter per channel over interleaved audio.
+// Channels are deinterleaved into planes, processed (on parallel worker
+// threads when the channel count and FFT size make it worthwhile) and
+// interleaved back. With phase locking, channel 0 is the phase reference:
+// it runs each hop first and the other channels follow its phases.
+// max_threads caps the threads used (including the caller); 0 means one per
+// core. Callers that already parallelise across streams pass 1.
+//
+// Each channel has both an STFT and a WSOLA shifter; set_engine() picks the
+// one in use and takes effect at the start of the next process() call, so it
+// is safe to call from another thread. The WSOLA path runs on the calling
+// thread, since its per-channel work is cheaper than a hand-off.
+class MultiChannelShifter {
+public:
+    MultiChannelShifter(size_t channels, size_t fft_size, size_t hop_size, int sample_rate,
+                        bool phase_lock = false, size_t max_threads = 0);
+    ~MultiChannelShifter();
+
+    void set_pitch_ratio(float ratio);
+    float get_pitch_ratio() const { return stft_[0]->get_pitch_ratio(); }
+
+    void set_volume(float vol);
+    float get_volume() const { return stft_[0]->get_volume(); }
+
+    void set_engine(ShiftEngine engine) { requested_engine_.store(engine, std::memory_order_relaxed); }
+    ShiftEngine engine() const { return requested_engine_.load(std::memory_order_relaxed); }
+
+    static bool parse_engine(const std::string& name, ShiftEngine& engine);
+    static const char* engine_name(ShiftEngine engine);
+
+    // input/output hold num_frames interleaved frames
+    void process(const float* input, float* output, int num_frames);
+
+    // Band spectrum of channel 0
+    void get_spectrum(const SpectrumBands& bands, float* band_db);
+
+    void reset();
+
+    // Prefault both engines of every channel and the planes; call before
+    // processing starts. Returns the bytes touched.
+    size_t prefault();
+
+    // Split each channel's STFT into analysis and synthesis threads (see
+    // PitchShifter); not available with phase locking, whose followers read
+    // the reference's synthesis state. Call before processing starts.
+    bool set_pipelined(bool pipelined);
+    bool pipelined() const { return stft_[0]->pipelined(); }
+
+    // Run the DSP workers (and pipelined synthesis threads) at SCHED_FIFO
+    // priority with denormals flushed to zero; call before processing
+    // starts. Returns 0, or the errno of the first worker that was refused.
+    int set_worker_realtime(int priority);
+
+    // Of the requested engine
+    size_t latency_samples() const;
+    size_t fft_size() const { return stft_[0]->fft_size(); }
+    size_t channels() const { return shifters_.size(); }
+    bool parallel() const { return !workers_.empty(); }
+
+private:
+    void apply_engine();
+    void process_planes(size_t first_channel, size_t offset, size_t frames);
+    void process_channels(size_t slot, size_t first_channel, size_t offset, size_t frames);
+    void dispatch(size_t first_channel, size_t offset, size_t frames);
+    void worker_loop(size_t slot);
+
+    std::vector<std::unique_ptr<PitchShifter>> stft_;
+    std::vector<std::unique_ptr<WsolaShifter>> wsola_;
+    std::vector<Shifter*> shifters_;  // the active engine's, one per channel
+    ShiftEngine engine_;
+    std::atomic<ShiftEngine> requested_engine_;
+    std::vector<std::vector<float>> in_planes_;
+    std::vector<std::vector<float>> out_planes_;
+    std::vector<float*> in_ptrs_;
+    std::vector<float*> out_ptrs_;
+    bool phase_lock_;
+    size_t hop_fill_;
+
+    // Fork-join workers; slot 0 is the calling thread. The job fields are
+    // written only while no job is pending, then published by the posts.
+    std::vector<std::thread> workers_;
+    std::vector<std::unique_ptr<Semaphore>> wakes_;  // one per worker
+    std::atomic<bool> stopping_;
+    size_t job_first_channel_;
+    size_t job_offset_;
+    size_t job_frames_;
+    std::atomic<size_t> pending_;
+    std::atomic<int> worker_priority_;
+    std::atomic<int> worker_error_;
+};
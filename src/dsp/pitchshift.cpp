@@ -1,66 +1,385 @@
 #include "dsp/pitchshift.h"
+#include "dsp/simd.h"
+#include "utils/alloc_check.h"
+#include "utils/logger.h"
+#include "utils/realtime.h"
+#include "utils/trace.h"
 #include "config.h"
 #include <cmath>
 #include <algorithm>
+#include <cstring>
 #include <vector>
 
+namespace {
+    constexpr float PI = static_cast<float>(M_PI);
+    constexpr float TWO_PI = 2.0f * PI;
+
+    // Wrap a phase into [-pi, pi]
+    inline float wrap_phase(float phase) {
+        return phase - TWO_PI * std::floor((phase + PI) / TWO_PI);
+    }
+}
+
 PitchShifter::PitchShifter(size_t fft_size, size_t hop_size, int sample_rate)
-    : fft_size_(fft_size), hop_size_(hop_size), sample_rate_(sample_rate),
-      pitch_ratio_(1.0f), volume_(1.0f),
+    : fft_size_(fft_size), hop_size_(hop_size), sample_rate_(sample_rate), idle_(true),
+      kernels_(select_kernels(fft_size)),
       Hann_window_(fft_size),
-      input_buffer_(fft_size),
-      output_buffer_(fft_size),
-      fft_real_(fft_size / 2 + 1),
-      fft_imag_(fft_size / 2 + 1) {
+      synthesis_window_(fft_size),
+      in_ring_(fft_size),
+      out_ring_(fft_size),
+      out_ready_(hop_size),
+      in_pos_(0), hop_fill_(0),
+      last_phase_(fft_size / 2 + 1),
+      sum_phase_(fft_size / 2 + 1),
+      ana_magn_(fft_size / 2 + 1),
+      ana_freq_(fft_size / 2 + 1),
+      syn_magn_(fft_size / 2 + 1),
+      syn_freq_(fft_size / 2 + 1),
+      phase_ref_(nullptr),
+      syn_dphase_(fft_size / 2 + 1),
+      in_flight_(0), synthesis_stop_(false), synthesis_priority_(0),
+      priority_pending_(false), priority_error_(0) {
 
     fft_ = std::make_unique<FFTProcessor>(fft_size);
 
+    // Periodic Hann so that overlapping windows sum to a constant
+    for (size_t i = 0; i < fft_size; i++) {
+        Hann_window_[i] = 0.5f * (1.0f - std::cos(2.0f * M_PI * i / fft_size));
+    }
+
+    // Analysis and synthesis both apply the window, so normalise by the
+    // average overlap-added sum of the squared window. The unnormalised
+    // inverse FFT's 1/fft_size is folded in as well.
+    float ola_sum = 0.0f;
     for (size_t i = 0; i < fft_size; i++) {
-        Hann_window_[i] = 0.5f * (1.0f - std::cos(2.0f * M_PI * i / (fft_size - 1)));
+        ola_sum += Hann_window_[i] * Hann_window_[i];
     }
+    float ola_scale = static_cast<float>(hop_size) / (ola_sum * fft_size);
+    for (size_t i = 0; i < fft_size; i++) {
+        synthesis_window_[i] = Hann_window_[i] * ola_scale;
+    }
+
+    reset();
+}
 
-    std::fill(input_buffer_.begin(), input_buffer_.end(), 0.0f);
-    std::fill(output_buffer_.begin(), output_buffer_.end(), 0.0f);
+PitchShifter::~PitchShifter() {
+    set_pipelined(false);
 }
 
-PitchShifter::~PitchShifter() = default;
+PitchShifter::Kernels PitchShifter::select_kernels(size_t fft_size) {
+    switch (fft_size) {
+        case 512:  return {&PitchShifter::analyze_frame<512>, &PitchShifter::synthesize_frame<512>};
+        case 1024: return {&PitchShifter::analyze_frame<1024>, &PitchShifter::synthesize_frame<1024>};
+        case 2048: return {&PitchShifter::analyze_frame<2048>, &PitchShifter::synthesize_frame<2048>};
+        case 4096: return {&PitchShifter::analyze_frame<4096>, &PitchShifter::synthesize_frame<4096>};
+        case 8192: return {&PitchShifter::analyze_frame<8192>, &PitchShifter::synthesize_frame<8192>};
+        default:   return {&PitchShifter::analyze_frame<0>, &PitchShifter::synthesize_frame<0>};
+    }
+}
+
+bool PitchShifter::has_fixed_kernel(size_t fft_size) {
+    return select_kernels(fft_size).analyze != &PitchShifter::analyze_frame<0>;
+}
 
 void PitchShifter::set_pitch_ratio(float ratio) {
-    pitch_ratio_ = ratio;
+    pitch_.set(std::max(0.25f, std::min(ratio, 4.0f)), PITCH_GLIDE_FRAMES / hop_size_);
+    if (idle_) pitch_.snap();
 }
 
 void PitchShifter::set_volume(float vol) {
-    volume_ = std::max(0.0f, std::min(vol, 1.0f));
+    gain_.set(std::max(0.0f, std::min(vol, 1.0f)));
+    if (idle_) gain_.snap();
+}
+
+void PitchShifter::set_pipelined(bool pipelined) {
+    if (pipelined == this->pipelined()) return;
+
+    if (!pipelined) {
+        drain_pipeline();
+        synthesis_stop_.store(true, std::memory_order_release);
+        synthesis_ready_.post();
+        synthesis_thread_.join();
+        reset();
+        return;
+    }
+
+    if (!synthesis_fft_) {
+        const size_t bins = fft_size_ / 2 + 1;
+        synthesis_fft_ = std::make_unique<FFTProcessor>(fft_size_);
+        frames_ = std::make_unique<SPSCQueue<AnalysisFrame>>(
+            PIPELINE_QUEUE_FRAMES, AnalysisFrame{std::vector<float>(bins), std::vector<float>(bins), 1.0f, 0});
+        hops_ = std::make_unique<SPSCQueue<std::vector<float>>>(PIPELINE_QUEUE_FRAMES, std::vector<float>(hop_size_));
+    }
+    reset();
+    synthesis_ready_.clear();
+    synthesis_stop_.store(false, std::memory_order_relaxed);
+    synthesis_thread_ = std::thread(&PitchShifter::synthesis_loop, this);
+    if (synthesis_priority_ > 0 && set_thread_priority(synthesis_priority_) != 0) {
+        LOG_ERRORF("Synthesis thread: SCHED_FIFO refused (errno %d)", priority_error_);
+    }
+}
+
+int PitchShifter::set_thread_priority(int priority) {
+    std::unique_lock<std::mutex> lock(synthesis_mutex_);
+    synthesis_priority_ = priority;
+    if (priority <= 0 || !pipelined()) return 0;
+
+    // The thread is idle before processing starts, so this returns promptly
+    priority_pending_.store(true, std::memory_order_release);
+    synthesis_ready_.post();
+    priority_applied_.wait(lock, [&] { return !priority_pending_.load(std::memory_order_acquire); });
+    return priority_error_;
+}
+
+// Waits for every frame in flight, so the synthesis state may be touched
+void PitchShifter::drain_pipeline() {
+    while (in_flight_ > 0) {
+        while (!hops_->front()) {
+            std::this_thread::yield();
+        }
+        hops_->pop();
+        in_flight_--;
+    }
+}
+
+void PitchShifter::reset() {
+    if (pipelined()) drain_pipeline();
+    std::fill(in_ring_.begin(), in_ring_.end(), 0.0f);
+    std::fill(out_ring_.begin(), out_ring_.end(), 0.0f);
+    std::fill(out_ready_.begin(), out_ready_.end(), 0.0f);
+    std::fill(last_phase_.begin(), last_phase_.end(), 0.0f);
+    std::fill(sum_phase_.begin(), sum_phase_.end(), 0.0f);
+    std::fill(ana_magn_.begin(), ana_magn_.end(), 0.0f);
+    in_pos_ = 0;
+    hop_fill_ = 0;
+    pitch_.snap();
+    gain_.snap();
+    idle_ = true;
+}
+
+size_t PitchShifter::prefault() {
+    reset();
+    size_t bytes = fft_->prefault();
+    if (synthesis_fft_) {
+        bytes += synthesis_fft_->prefault();
+        bytes += (frames_->capacity() * 2 * (fft_size_ / 2 + 1) + hops_->capacity() * hop_size_) * sizeof(float);
+    }
+    for (std::vector<float>* buffer : {&ana_freq_, &syn_magn_, &syn_freq_, &syn_dphase_}) {
+        std::fill(buffer->begin(), buffer->end(), 0.0f);
+    }
+    for (const std::vector<float>* buffer : {&Hann_window_, &synthesis_window_, &in_ring_, &out_ring_, &out_ready_,
+                                             &last_phase_, &sum_phase_, &ana_magn_, &ana_freq_, &syn_magn_,
+                                             &syn_freq_, &syn_dphase_}) {
+        bytes += buffer->size() * sizeof(float);
+    }
+    return bytes;
 }
 
 void PitchShifter::process(const float* input, float* output, int num_frames) {
-    for (size_t i = 0; i < fft_size_; i++) {
-        if (i < static_cast<size_t>(num_frames)) {
-            input_buffer_[i] = input[i] * Hann_window_[i];
-        } else {
-            input_buffer_[i] = 0.0f;
+    idle_ = false;
+    int done = 0;
+    while (done < num_frames) {
+        size_t n = std::min(hop_size_ - hop_fill_, static_cast<size_t>(num_frames - done));
+
+        // Push input into the ring (at most one wrap)
+        size_t first = std::min(n, fft_size_ - in_pos_);
+        std::memcpy(&in_ring_[in_pos_], input + done, first * sizeof(float));
+        std::memcpy(&in_ring_[0], input + done + first, (n - first) * sizeof(float));
+        in_pos_ = (in_pos_ + n) % fft_size_;
+
+        // Emit the previously finished hop
+        gain_.apply(&out_ready_[hop_fill_], output + done, n);
+
+        hop_fill_ += n;
+        done += static_cast<int>(n);
+
+        if (hop_fill_ == hop_size_) {
+            if (pipelined()) {
+                process_frame_pipelined();
+            } else {
+                process_frame();
+            }
+            hop_fill_ = 0;
         }
     }
+}
 
-    fft_->forward(input_buffer_.data(), fft_real_.data(), fft_imag_.data());
+void PitchShifter::process_frame() {
+    (this->*kernels_.analyze)();
+    (this->*kernels_.synthesize)(*fft_, ana_magn_.data(), ana_freq_.data(), pitch_.next(), in_pos_,
+                                 out_ready_.data());
+}
 
-    fft_->inverse(fft_real_.data(), fft_imag_.data(), output_buffer_.data());
+// Analyse this frame and hand it over, then collect the previous frame's hop,
+// which the synthesis thread has had a whole hop to finish
+void PitchShifter::process_frame_pipelined() {
+    (this->*kernels_.analyze)();
+
+    AnalysisFrame* frame = frames_->begin_write();
+    if (frame) {
+        std::copy(ana_magn_.begin(), ana_magn_.end(), frame->magn.begin());
+        std::copy(ana_freq_.begin(), ana_freq_.end(), frame->freq.begin());
+        frame->pitch_ratio = pitch_.next();
+        frame->in_pos = in_pos_;
+        frames_->commit_write();
+        synthesis_ready_.post();
+        in_flight_++;
+    }
 
-    for (size_t i = 0; i < fft_size_; i++) {
-        output_buffer_[i] *= Hann_window_[i] * volume_;
+    if (in_flight_ < 2) {
+        std::fill(out_ready_.begin(), out_ready_.end(), 0.0f);
+        return;
     }
+    std::vector<float>* hop;
+    {
+        TRACE_SCOPE("synthesis_wait");
+        while (!(hop = hops_->front())) {
+            std::this_thread::yield();
+        }
+    }
+    std::copy(hop->begin(), hop->end(), out_ready_.begin());
+    hops_->pop();
+    in_flight_--;
+}
+
+void PitchShifter::synthesis_loop() {
+    TRACE_THREAD("dsp-synthesis");
+    AllocCheck::watch_thread();
+    for (;;) {
+        synthesis_ready_.wait();
+        if (synthesis_stop_.load(std::memory_order_acquire)) return;
+
+        if (priority_pending_.load(std::memory_order_acquire)) {
+            Realtime::disable_denormals();
+            Realtime::prefault_stack();
+            int error = Realtime::set_fifo(synthesis_priority_);
+            std::lock_guard<std::mutex> lock(synthesis_mutex_);
+            priority_error_ = error;
+            priority_pending_.store(false, std::memory_order_release);
+            priority_applied_.notify_all();
+        }
+
+        // Empty after a priority request
+        AnalysisFrame* frame = frames_->front();
+        if (!frame) continue;
+
+        // Never full: the caller collects a hop for every frame it sends
+        std::vector<float>* hop = hops_->begin_write();
+        (this->*kernels_.synthesize)(*synthesis_fft_, frame->magn.data(), frame->freq.data(),
+                                     frame->pitch_ratio, frame->in_pos, hop->data());
+        frames_->pop();
+        hops_->commit_write();
+    }
+}
+
+template <size_t N>
+void PitchShifter::analyze_frame() {
+    const size_t fft_size = N ? N : fft_size_;
+    const size_t half = fft_size / 2;
+    const float osamp = static_cast<float>(fft_size) / hop_size_;
+    const float expected = TWO_PI * hop_size_ / fft_size;
+    const float freq_per_bin = static_cast<float>(sample_rate_) / fft_size;
+
+    // Window the last fft_size samples straight into the FFT buffer,
+    // oldest first (in_pos_ is the oldest)
+    float* frame = fft_->time_buffer();
+    fftwf_complex* bins = fft_->spectrum();
+    size_t tail = fft_size - in_pos_;
+    {
+        TRACE_SCOPE("window");
+        simd::multiply(&in_ring_[in_pos_], Hann_window_.data(), frame, tail);
+        simd::multiply(in_ring_.data(), &Hann_window_[tail], frame + tail, in_pos_);
+    }
+
+    fft_->execute_forward();
 
-    for (int i = 0; i < num_frames; i++) {
-        output[i] = output_buffer_[i];
+    // Analysis: magnitude and true frequency of each bin
+    {
+        TRACE_SCOPE("analysis");
+        simd::magnitude(&bins[0][0], ana_magn_.data(), half + 1);
+        for (size_t k = 0; k <= half; k++) {
+            float re = bins[k][0];
+            float im = bins[k][1];
+            float phase = std::atan2(im, re);
+
+            float delta = phase - last_phase_[k];
+            last_phase_[k] = phase;
+
+            delta = wrap_phase(delta - k * expected);
+            float deviation = osamp * delta / TWO_PI;
+
+            ana_freq_[k] = (k + deviation) * freq_per_bin;
+        }
     }
 }
 
-void PitchShifter::get_spectrum(float* spectrum, size_t num_bins) {
-    for (size_t i = 0; i < num_bins && i < fft_size_ / 2 + 1; i++) {
-        float magnitude = std::sqrt(fft_real_[i] * fft_real_[i] + 
-                                     fft_imag_[i] * fft_imag_[i]);
-        
-        float db = 20.0f * std::log10(magnitude + 1e-10f);
-        spectrum[i] = std::max(SPECTRUM_MIN_DB, std::min(db, SPECTRUM_MAX_DB));
+template <size_t N>
+void PitchShifter::synthesize_frame(FFTProcessor& fft, const float* magn, const float* freq,
+                                    float pitch_ratio, size_t in_pos, float* hop_out) {
+    const size_t fft_size = N ? N : fft_size_;
+    const size_t half = fft_size / 2;
+    const float osamp = static_cast<float>(fft_size) / hop_size_;
+    const float expected = TWO_PI * hop_size_ / fft_size;
+    const float freq_per_bin = static_cast<float>(sample_rate_) / fft_size;
+
+    float* frame = fft.time_buffer();
+    fftwf_complex* bins = fft.spectrum();
+    size_t tail = fft_size - in_pos;
+
+    // Pitch shift: move bins
+    {
+        TRACE_SCOPE("shift");
+        std::fill(syn_magn_.begin(), syn_magn_.end(), 0.0f);
+        std::fill(syn_freq_.begin(), syn_freq_.end(), 0.0f);
+        if (phase_ref_) {
+            std::fill(syn_dphase_.begin(), syn_dphase_.end(), 0.0f);
+        }
+        for (size_t k = 0; k <= half; k++) {
+            size_t index = static_cast<size_t>(k * pitch_ratio);
+            if (index > half) break;
+            syn_magn_[index] += magn[k];
+            syn_freq_[index] = freq[k] * pitch_ratio;
+            if (phase_ref_) {
+                syn_dphase_[index] = last_phase_[k] - phase_ref_->last_phase_[k];
+            }
+        }
     }
+
+    // Synthesis: accumulate phase from the shifted frequencies, or follow
+    // the reference channel's phase when locked
+    {
+        TRACE_SCOPE("synthesis");
+        for (size_t k = 0; k <= half; k++) {
+            if (phase_ref_) {
+                sum_phase_[k] = wrap_phase(phase_ref_->sum_phase_[k] + syn_dphase_[k]);
+            } else {
+                float deviation = syn_freq_[k] / freq_per_bin - k;
+                float advance = TWO_PI * deviation / osamp + k * expected;
+                sum_phase_[k] = wrap_phase(sum_phase_[k] + advance);
+            }
+
+            bins[k][0] = syn_magn_[k] * std::cos(sum_phase_[k]);
+            bins[k][1] = syn_magn_[k] * std::sin(sum_phase_[k]);
+        }
+    }
+
+    fft.execute_inverse();
+
+    // Overlap-add into the output ring, aligned with the oldest input sample
+    {
+        TRACE_SCOPE("overlap_add");
+        simd::multiply_add(frame, synthesis_window_.data(), &out_ring_[in_pos], tail);
+        simd::multiply_add(frame + tail, &synthesis_window_[tail], out_ring_.data(), in_pos);
+
+        // The oldest hop has received all of its overlapping frames
+        for (size_t i = 0; i < hop_size_; i++) {
+            size_t pos = (in_pos + i) % fft_size;
+            hop_out[i] = out_ring_[pos];
+            out_ring_[pos] = 0.0f;
+        }
+    }
+}
+
+void PitchShifter::get_spectrum(const SpectrumBands& bands, float* band_db) {
+    bands.compute(ana_magn_.data(), band_db);
 }
@@ -1,36 +1,145 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
 #include <cstddef>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include "dsp/fft.h"
+#include "dsp/ramp.h"
+#include "dsp/shifter.h"
+#include "dsp/spectrum_bands.h"
+#include "utils/semaphore.h"
+#include "utils/spsc_queue.h"
 
-class PitchShifter {
+// Streaming STFT phase vocoder (SMB PitchShift).
+// Input is collected into a ring buffer; every hop_size samples one frame of
+// fft_size samples is analysed, pitch shifted and overlap-added into the
+// output ring. Blocks of any length may be passed to process(); the output is
+// delayed by a fixed latency_samples().
+//
+// In pipelined mode analysis (window, forward FFT, phase analysis) stays on
+// the calling thread while synthesis (bin shift, phase synthesis, inverse
+// FFT, overlap-add) runs on a thread of its own with its own FFT buffers.
+// Analysed frames and finished hops pass through preallocated SPSC queues,
+// and each hop is collected one hop after its frame was analysed, so a
+// frame's synthesis overlaps the next hop's input. This adds hop_size()
+// samples of latency and roughly halves the work on the calling thread.
+class PitchShifter : public Shifter {
 public:
     PitchShifter(size_t fft_size, size_t hop_size, int sample_rate);
-    ~PitchShifter();
+    ~PitchShifter() override;
 
-    void set_pitch_ratio(float ratio);
-    float get_pitch_ratio() const { return pitch_ratio_; }
+    void set_pitch_ratio(float ratio) override;
+    float get_pitch_ratio() const override { return pitch_.target(); }
 
-    void set_volume(float vol);
-    float get_volume() const { return volume_; }
+    void set_volume(float vol) override;
+    float get_volume() const override { return gain_.target(); }
 
-    void process(const float* input, float* output, int num_frames);
+    void process(const float* input, float* output, int num_frames) override;
 
-    void get_spectrum(float* spectrum, size_t num_bins);
+    // Band levels of the last analysed frame
+    void get_spectrum(const SpectrumBands& bands, float* band_db) override;
+
+    void reset() override;
+    size_t prefault() override;
+
+    // Lock synthesis phases to a reference channel, keeping the input's
+    // inter-channel phase differences so the stereo image stays stable.
+    // The reference must process each hop before this shifter does.
+    void set_phase_reference(const PitchShifter* reference) { phase_ref_ = reference; }
+
+    // Start or stop the synthesis thread; call before processing, not
+    // together with a phase reference (synthesis would race its phases)
+    void set_pipelined(bool pipelined);
+    bool pipelined() const { return synthesis_thread_.joinable(); }
+
+    // SCHED_FIFO priority and FTZ/DAZ for the synthesis thread (see
+    // Realtime); 0 leaves it as it is. Applied now when pipelined, waiting
+    // for the thread, otherwise when set_pipelined() starts it. Call before
+    // processing. Returns 0, or the errno of the refused SCHED_FIFO request.
+    int set_thread_priority(int priority);
+
+    size_t latency_samples() const override { return fft_size_ + (pipelined() ? hop_size_ : 0); }
+    size_t fft_size() const { return fft_size_; }
+    size_t hop_size() const override { return hop_size_; }
+
+    // Whether fft_size() has a fixed-size kernel
+    static bool has_fixed_kernel(size_t fft_size);
 
 private:
+    // An analysed frame on its way to the synthesis thread
+    struct AnalysisFrame {
+        std::vector<float> magn;
+        std::vector<float> freq;
+        float pitch_ratio;
+        size_t in_pos;  // ring position the frame starts at
+    };
+
+    // The two halves of one STFT frame. The common FFT sizes (512-8192) get
+    // instantiations with the size fixed at compile time, so the bin loops
+    // unroll and vectorise and ring indexing becomes a mask; N = 0 is the
+    // generic kernel for any other size. The constructor picks one.
+    // Analysis fills ana_magn_/ana_freq_ from the input ring; synthesis turns
+    // magnitudes and frequencies into the next finished hop.
+    template <size_t N> void analyze_frame();
+    template <size_t N> void synthesize_frame(FFTProcessor& fft, const float* magn, const float* freq,
+                                              float pitch_ratio, size_t in_pos, float* hop_out);
+    struct Kernels {
+        void (PitchShifter::*analyze)();
+        void (PitchShifter::*synthesize)(FFTProcessor&, const float*, const float*, float, size_t, float*);
+    };
+    static Kernels select_kernels(size_t fft_size);
+
+    void process_frame();
+    void process_frame_pipelined();
+    void synthesis_loop();
+    void drain_pipeline();
+
     size_t fft_size_;
     size_t hop_size_;
     int sample_rate_;
-    float pitch_ratio_;
-    float volume_;
+    PitchGlide pitch_;  // one step per hop
+    GainRamp gain_;
+    bool idle_;         // nothing processed since reset(): changes snap
+    Kernels kernels_;
 
     std::unique_ptr<FFTProcessor> fft_;
     std::vector<float> Hann_window_;
-    std::vector<float> input_buffer_;
-    std::vector<float> output_buffer_;
-    std::vector<float> fft_real_;
-    std::vector<float> fft_imag_;
+    std::vector<float> synthesis_window_;  // Hann * overlap-add and IFFT normalisation
+
+    // Ring buffers. Both rings share in_pos_: at a hop boundary it marks the
+    // oldest input sample and the output slot that frame starts at.
+    std::vector<float> in_ring_;    // last fft_size input samples
+    std::vector<float> out_ring_;   // overlap-add accumulator
+    std::vector<float> out_ready_;  // finished hop, emitted while the next one is collected
+    size_t in_pos_;
+    size_t hop_fill_;
+
+    // Phase vocoder state
+    std::vector<float> last_phase_;
+    std::vector<float> sum_phase_;
+    std::vector<float> ana_magn_;
+    std::vector<float> ana_freq_;
+    std::vector<float> syn_magn_;
+    std::vector<float> syn_freq_;
+
+    const PitchShifter* phase_ref_;
+    std::vector<float> syn_dphase_;  // phase offset to the reference, per synthesis bin
+
+    // Pipelined mode
+    std::unique_ptr<FFTProcessor> synthesis_fft_;
+    std::unique_ptr<SPSCQueue<AnalysisFrame>> frames_;
+    std::unique_ptr<SPSCQueue<std::vector<float>>> hops_;
+    size_t in_flight_;  // frames sent whose hop has not been collected
+    std::thread synthesis_thread_;
+    Semaphore synthesis_ready_;               // one post per frame, stop or priority request
+    std::atomic<bool> synthesis_stop_;
+    std::mutex synthesis_mutex_;              // start-up priority handshake only
+    int synthesis_priority_;
+    std::atomic<bool> priority_pending_;      // for the synthesis thread to apply
+    int priority_error_;
+    std::condition_variable priority_applied_;
 };
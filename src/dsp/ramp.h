@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include "dsp/simd.h"
+#include "config.h"
+
+// Parameter smoothing for the shifters, so changes never step mid-signal.
+// Both are plain audio-thread state: the engine's control queue delivers the
+// changes, and set() is called on the audio thread.
+
+// Output gain, moving linearly to its target over GAIN_RAMP_FRAMES samples.
+// apply() folds the ramp into the output scaling pass.
+class GainRamp {
+public:
+    explicit GainRamp(float gain = 1.0f) : current_(gain), target_(gain), step_(0.0f), left_(0) {}
+
+    void set(float target) {
+        target_ = target;
+        left_ = GAIN_RAMP_FRAMES;
+        step_ = (target_ - current_) / GAIN_RAMP_FRAMES;
+    }
+
+    // Jump to the target, e.g. on reset
+    void snap() {
+        current_ = target_;
+        left_ = 0;
+    }
+
+    float target() const { return target_; }
+
+    // out[i] = in[i] * gain for n samples, advancing the ramp
+    void apply(const float* in, float* out, size_t n) {
+        if (left_ == 0) {
+            simd::scale(in, current_, out, n);
+            return;
+        }
+        size_t m = std::min(n, left_);
+        simd::scale_ramp(in, current_, step_, out, m);
+        advance(m);
+        if (m < n) simd::scale(in + m, current_, out + m, n - m);
+    }
+
+    // Gain for one sample, for loops that produce samples one by one
+    float next() {
+        float gain = current_;
+        if (left_ > 0) advance(1);
+        return gain;
+    }
+
+private:
+    void advance(size_t n) {
+        left_ -= n;
+        current_ = left_ == 0 ? target_ : current_ + step_ * n;
+    }
+
+    float current_;
+    float target_;
+    float step_;
+    size_t left_;
+};
+
+// Pitch ratio, gliding geometrically (evenly in semitones) to its target in
+// a given number of steps: hops for the STFT, samples for WSOLA.
+class PitchGlide {
+public:
+    explicit PitchGlide(float ratio = 1.0f) : current_(ratio), target_(ratio), factor_(1.0), left_(0) {}
+
+    void set(float target, size_t steps) {
+        target_ = target;
+        left_ = std::max<size_t>(steps, 1);
+        factor_ = std::pow(static_cast<double>(target_) / current_, 1.0 / left_);
+    }
+
+    void snap() {
+        current_ = target_;
+        left_ = 0;
+    }
+
+    float target() const { return target_; }
+    float current() const { return static_cast<float>(current_); }
+    bool gliding() const { return left_ > 0; }
+
+    // Ratio for the next step
+    float next() {
+        if (left_ > 0) {
+            current_ = --left_ == 0 ? target_ : current_ * factor_;
+        }
+        return static_cast<float>(current_);
+    }
+
+private:
+    double current_;
+    float target_;
+    double factor_;
+    size_t left_;
+};
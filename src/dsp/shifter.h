@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include "dsp/spectrum_bands.h"
+
+enum class ShiftEngine {
+    STFT,   // phase vocoder: best quality, FFT_SIZE samples of latency
+    WSOLA   // time-domain overlap-add: a few ms of latency, for live monitoring
+};
+
+// Single-channel pitch shifter. Blocks of any length may be passed to
+// process(); the output is delayed by about latency_samples().
+class Shifter {
+public:
+    virtual ~Shifter() = default;
+
+    // Pitch and volume changes are smoothed (dsp/ramp.h), except before the
+    // first process() after construction or reset(): initial and offline
+    // settings take effect at once
+    virtual void set_pitch_ratio(float ratio) = 0;
+    virtual float get_pitch_ratio() const = 0;
+
+    virtual void set_volume(float vol) = 0;
+    virtual float get_volume() const = 0;
+
+    virtual void process(const float* input, float* output, int num_frames) = 0;
+
+    // Band levels of the recent input, bands.bands() values in dB
+    virtual void get_spectrum(const SpectrumBands& bands, float* band_db) = 0;
+
+    virtual void reset() = 0;
+
+    // Reset and write every buffer the shifter owns, so they are resident
+    // before the first block; returns the bytes touched
+    virtual size_t prefault() = 0;
+
+    virtual size_t latency_samples() const = 0;
+
+    // Phase-locked channels are processed in steps of hop_size() frames,
+    // the reference channel first
+    virtual size_t hop_size() const = 0;
+};
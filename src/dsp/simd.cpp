@@ -0,0 +1,750 @@
+#include "dsp/simd.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define VOCODER_SIMD_X86 1
+#endif
+
+namespace {
+    constexpr float DB_EPSILON = 1e-10f;
+    constexpr float DB_PER_LN = 8.6858896380650365f;  // 20 / ln(10)
+    constexpr float LN2 = 0.69314718055994531f;
+    constexpr float SQRT2 = 1.41421356237309505f;
+    constexpr float S16_SCALE = 32768.0f;
+    constexpr float S32_SCALE = 2147483648.0f;
+    constexpr float S32_MAX = 2147483520.0f;  // largest float below 2^31
+
+    // Scale and clamp for float_to_s32 at 24 or 32 bits
+    inline float s32_full_scale(int bits) { return std::ldexp(1.0f, bits - 1); }
+    inline float s32_top(int bits) { return bits == 32 ? S32_MAX : s32_full_scale(bits) - 1.0f; }
+
+    // ---------------------------------------------------------------- scalar
+
+    void multiply_scalar(const float* a, const float* b, float* out, size_t n) {
+        for (size_t i = 0; i < n; i++) out[i] = a[i] * b[i];
+    }
+
+    void multiply_add_scalar(const float* a, const float* b, float* acc, size_t n) {
+        for (size_t i = 0; i < n; i++) acc[i] += a[i] * b[i];
+    }
+
+    void scale_scalar(const float* in, float gain, float* out, size_t n) {
+        for (size_t i = 0; i < n; i++) out[i] = in[i] * gain;
+    }
+
+    void scale_ramp_scalar(const float* in, float start, float step, float* out, size_t n) {
+        for (size_t i = 0; i < n; i++) out[i] = in[i] * (start + static_cast<float>(i) * step);
+    }
+
+    float sum_squares_scalar(const float* x, size_t n) {
+        float sum = 0.0f;
+        for (size_t i = 0; i < n; i++) sum += x[i] * x[i];
+        return sum;
+    }
+
+    void magnitude_scalar(const float* z, float* mag, size_t n) {
+        for (size_t k = 0; k < n; k++) {
+            mag[k] = std::sqrt(z[2 * k] * z[2 * k] + z[2 * k + 1] * z[2 * k + 1]);
+        }
+    }
+
+    void magnitude_to_db_scalar(const float* mag, float* out, size_t n, float min_db, float max_db) {
+        for (size_t k = 0; k < n; k++) {
+            float db = 20.0f * std::log10(mag[k] + DB_EPSILON);
+            out[k] = std::max(min_db, std::min(db, max_db));
+        }
+    }
+
+    void deinterleave_scalar(const float* in, float* const* out, size_t channels, size_t frames) {
+        for (size_t c = 0; c < channels; c++) {
+            float* plane = out[c];
+            for (size_t i = 0; i < frames; i++) plane[i] = in[i * channels + c];
+        }
+    }
+
+    void interleave_scalar(const float* const* in, float* out, size_t channels, size_t frames) {
+        for (size_t c = 0; c < channels; c++) {
+            const float* plane = in[c];
+            for (size_t i = 0; i < frames; i++) out[i * channels + c] = plane[i];
+        }
+    }
+
+    void s16_to_float_scalar(const int16_t* in, float* out, size_t n) {
+        for (size_t i = 0; i < n; i++) out[i] = in[i] * (1.0f / S16_SCALE);
+    }
+
+    void float_to_s16_scalar(const float* in, int16_t* out, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            float v = std::max(-S16_SCALE, std::min(in[i] * S16_SCALE, S16_SCALE - 1.0f));
+            out[i] = static_cast<int16_t>(std::lrint(v));
+        }
+    }
+
+    // 24-bit samples are shifted up to full scale first, which also drops
+    // whatever the container's top byte holds
+    void s32_to_float_scalar(const int32_t* in, float* out, size_t n, int bits) {
+        const int shift = 32 - bits;
+        for (size_t i = 0; i < n; i++) {
+            int32_t v = static_cast<int32_t>(static_cast<uint32_t>(in[i]) << shift);
+            out[i] = v * (1.0f / S32_SCALE);
+        }
+    }
+
+    void float_to_s32_scalar(const float* in, int32_t* out, size_t n, int bits) {
+        const float full = s32_full_scale(bits);
+        const float top = s32_top(bits);
+        for (size_t i = 0; i < n; i++) {
+            float v = std::max(-full, std::min(in[i] * full, top));
+            out[i] = static_cast<int32_t>(std::lrint(v));
+        }
+    }
+
+#ifdef VOCODER_SIMD_X86
+    // ------------------------------------------------------------------ SSE2
+
+    // ln(x) for x > 0 normal: x = m * 2^e with m in [sqrt(0.5), sqrt(2)),
+    // ln(m) = 2 atanh(t), t = (m - 1) / (m + 1), |t| < 0.172, series to t^7.
+    inline __m128 ln_sse2(__m128 x) {
+        __m128i bits = _mm_castps_si128(x);
+        __m128i e = _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127));
+        __m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF)),
+                                                 _mm_set1_epi32(0x3F800000)));
+        __m128 big = _mm_cmpgt_ps(m, _mm_set1_ps(SQRT2));
+        m = _mm_or_ps(_mm_and_ps(big, _mm_mul_ps(m, _mm_set1_ps(0.5f))), _mm_andnot_ps(big, m));
+        __m128 ef = _mm_add_ps(_mm_cvtepi32_ps(e), _mm_and_ps(big, _mm_set1_ps(1.0f)));
+
+        __m128 one = _mm_set1_ps(1.0f);
+        __m128 t = _mm_div_ps(_mm_sub_ps(m, one), _mm_add_ps(m, one));
+        __m128 t2 = _mm_mul_ps(t, t);
+        __m128 p = _mm_add_ps(_mm_set1_ps(1.0f / 5.0f), _mm_mul_ps(t2, _mm_set1_ps(1.0f / 7.0f)));
+        p = _mm_add_ps(_mm_set1_ps(1.0f / 3.0f), _mm_mul_ps(t2, p));
+        p = _mm_add_ps(one, _mm_mul_ps(t2, p));
+        __m128 ln_m = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(2.0f), t), p);
+        return _mm_add_ps(_mm_mul_ps(ef, _mm_set1_ps(LN2)), ln_m);
+    }
+
+    void multiply_sse2(const float* a, const float* b, float* out, size_t n) {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        }
+        multiply_scalar(a + i, b + i, out + i, n - i);
+    }
+
+    void multiply_add_sse2(const float* a, const float* b, float* acc, size_t n) {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128 prod = _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+            _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), prod));
+        }
+        multiply_add_scalar(a + i, b + i, acc + i, n - i);
+    }
+
+    void scale_sse2(const float* in, float gain, float* out, size_t n) {
+        __m128 g = _mm_set1_ps(gain);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(in + i), g));
+        }
+        scale_scalar(in + i, gain, out + i, n - i);
+    }
+
+    // Gains come from the index rather than by accumulation, so long ramps
+    // end where the scalar loop does
+    void scale_ramp_sse2(const float* in, float start, float step, float* out, size_t n) {
+        const __m128 lanes = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+        const __m128 s0 = _mm_set1_ps(start);
+        const __m128 ds = _mm_set1_ps(step);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128 index = _mm_add_ps(_mm_set1_ps(static_cast<float>(i)), lanes);
+            __m128 gain = _mm_add_ps(s0, _mm_mul_ps(index, ds));
+            _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(in + i), gain));
+        }
+        for (; i < n; i++) out[i] = in[i] * (start + static_cast<float>(i) * step);
+    }
+
+    float sum_squares_sse2(const float* x, size_t n) {
+        __m128 acc0 = _mm_setzero_ps();
+        __m128 acc1 = _mm_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m128 v0 = _mm_loadu_ps(x + i);
+            __m128 v1 = _mm_loadu_ps(x + i + 4);
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(v0, v0));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(v1, v1));
+        }
+        float lanes[4];
+        _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+        return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sum_squares_scalar(x + i, n - i);
+    }
+
+    void magnitude_sse2(const float* z, float* mag, size_t n) {
+        size_t k = 0;
+        for (; k + 4 <= n; k += 4) {
+            __m128 lo = _mm_loadu_ps(z + 2 * k);      // r0 i0 r1 i1
+            __m128 hi = _mm_loadu_ps(z + 2 * k + 4);  // r2 i2 r3 i3
+            __m128 re = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+            __m128 im = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+            __m128 power = _mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im));
+            _mm_storeu_ps(mag + k, _mm_sqrt_ps(power));
+        }
+        magnitude_scalar(z + 2 * k, mag + k, n - k);
+    }
+
+    void magnitude_to_db_sse2(const float* mag, float* out, size_t n, float min_db, float max_db) {
+        __m128 eps = _mm_set1_ps(DB_EPSILON);
+        __m128 lo = _mm_set1_ps(min_db);
+        __m128 hi = _mm_set1_ps(max_db);
+        __m128 k_db = _mm_set1_ps(DB_PER_LN);
+        size_t k = 0;
+        for (; k + 4 <= n; k += 4) {
+            __m128 db = _mm_mul_ps(k_db, ln_sse2(_mm_add_ps(_mm_loadu_ps(mag + k), eps)));
+            _mm_storeu_ps(out + k, _mm_max_ps(lo, _mm_min_ps(db, hi)));
+        }
+        magnitude_to_db_scalar(mag + k, out + k, n - k, min_db, max_db);
+    }
+
+    // Stereo is vectorised; other channel counts use the scalar loops
+    void deinterleave_sse2(const float* in, float* const* out, size_t channels, size_t frames) {
+        if (channels != 2) return deinterleave_scalar(in, out, channels, frames);
+        float* left = out[0];
+        float* right = out[1];
+        size_t i = 0;
+        for (; i + 4 <= frames; i += 4) {
+            __m128 a = _mm_loadu_ps(in + 2 * i);      // L0 R0 L1 R1
+            __m128 b = _mm_loadu_ps(in + 2 * i + 4);  // L2 R2 L3 R3
+            _mm_storeu_ps(left + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(right + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+        float* rest[2] = {left + i, right + i};
+        deinterleave_scalar(in + 2 * i, rest, 2, frames - i);
+    }
+
+    void interleave_sse2(const float* const* in, float* out, size_t channels, size_t frames) {
+        if (channels != 2) return interleave_scalar(in, out, channels, frames);
+        const float* left = in[0];
+        const float* right = in[1];
+        size_t i = 0;
+        for (; i + 4 <= frames; i += 4) {
+            __m128 l = _mm_loadu_ps(left + i);
+            __m128 r = _mm_loadu_ps(right + i);
+            _mm_storeu_ps(out + 2 * i, _mm_unpacklo_ps(l, r));
+            _mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(l, r));
+        }
+        const float* rest[2] = {left + i, right + i};
+        interleave_scalar(rest, out + 2 * i, 2, frames - i);
+    }
+
+    void s16_to_float_sse2(const int16_t* in, float* out, size_t n) {
+        __m128 k = _mm_set1_ps(1.0f / S16_SCALE);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+            __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+            __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+            _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), k));
+            _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), k));
+        }
+        s16_to_float_scalar(in + i, out + i, n - i);
+    }
+
+    // Rounds with the current (nearest) rounding mode, like lrint
+    void float_to_s16_sse2(const float* in, int16_t* out, size_t n) {
+        __m128 k = _mm_set1_ps(S16_SCALE);
+        __m128 lo = _mm_set1_ps(-S16_SCALE);
+        __m128 hi = _mm_set1_ps(S16_SCALE - 1.0f);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m128 a = _mm_max_ps(lo, _mm_min_ps(_mm_mul_ps(_mm_loadu_ps(in + i), k), hi));
+            __m128 b = _mm_max_ps(lo, _mm_min_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 4), k), hi));
+            __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+        }
+        float_to_s16_scalar(in + i, out + i, n - i);
+    }
+
+    void s32_to_float_sse2(const int32_t* in, float* out, size_t n, int bits) {
+        __m128 k = _mm_set1_ps(1.0f / S32_SCALE);
+        __m128i shift = _mm_cvtsi32_si128(32 - bits);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128i v = _mm_sll_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), shift);
+            _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(v), k));
+        }
+        s32_to_float_scalar(in + i, out + i, n - i, bits);
+    }
+
+    void float_to_s32_sse2(const float* in, int32_t* out, size_t n, int bits) {
+        __m128 k = _mm_set1_ps(s32_full_scale(bits));
+        __m128 lo = _mm_set1_ps(-s32_full_scale(bits));
+        __m128 hi = _mm_set1_ps(s32_top(bits));
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128 v = _mm_max_ps(lo, _mm_min_ps(_mm_mul_ps(_mm_loadu_ps(in + i), k), hi));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_cvtps_epi32(v));
+        }
+        float_to_s32_scalar(in + i, out + i, n - i, bits);
+    }
+
+    // ------------------------------------------------------------------ AVX2
+
+    __attribute__((target("avx2,fma")))
+    inline __m256 ln_avx2(__m256 x) {
+        __m256i bits = _mm256_castps_si256(x);
+        __m256i e = _mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127));
+        __m256 m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)),
+                                                       _mm256_set1_epi32(0x3F800000)));
+        __m256 big = _mm256_cmp_ps(m, _mm256_set1_ps(SQRT2), _CMP_GT_OQ);
+        m = _mm256_blendv_ps(m, _mm256_mul_ps(m, _mm256_set1_ps(0.5f)), big);
+        __m256 ef = _mm256_add_ps(_mm256_cvtepi32_ps(e), _mm256_and_ps(big, _mm256_set1_ps(1.0f)));
+
+        __m256 one = _mm256_set1_ps(1.0f);
+        __m256 t = _mm256_div_ps(_mm256_sub_ps(m, one), _mm256_add_ps(m, one));
+        __m256 t2 = _mm256_mul_ps(t, t);
+        __m256 p = _mm256_fmadd_ps(t2, _mm256_set1_ps(1.0f / 7.0f), _mm256_set1_ps(1.0f / 5.0f));
+        p = _mm256_fmadd_ps(t2, p, _mm256_set1_ps(1.0f / 3.0f));
+        p = _mm256_fmadd_ps(t2, p, one);
+        __m256 ln_m = _mm256_mul_ps(_mm256_add_ps(t, t), p);
+        return _mm256_fmadd_ps(ef, _mm256_set1_ps(LN2), ln_m);
+    }
+
+    __attribute__((target("avx2,fma")))
+    void multiply_avx2(const float* a, const float* b, float* out, size_t n) {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+        }
+        multiply_scalar(a + i, b + i, out + i, n - i);
+    }
+
+    __attribute__((target("avx2,fma")))
+    void multiply_add_avx2(const float* a, const float* b, float* acc, size_t n) {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            _mm256_storeu_ps(acc + i, _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i),
+                                                      _mm256_loadu_ps(acc + i)));
+        }
+        multiply_add_scalar(a + i, b + i, acc + i, n - i);
+    }
+
+    __attribute__((target("avx2,fma")))
+    void scale_avx2(const float* in, float gain, float* out, size_t n) {
+        __m256 g = _mm256_set1_ps(gain);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(in + i), g));
+        }
+        scale_scalar(in + i, gain, out + i, n - i);
+    }
+
+    __attribute__((target("avx2,fma")))
+    void scale_ramp_avx2(const float* in, float start, float step, float* out, size_t n) {
+        const __m256 lanes = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+        const __m256 s0 = _mm256_set1_ps(start);
+        const __m256 ds = _mm256_set1_ps(step);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256 index = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(i)), lanes);
+            __m256 gain = _mm256_add_ps(s0, _mm256_mul_ps(index, ds));
+            _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(in + i), gain));
+        }
+        for (; i < n; i++) out[i] = in[i] * (start + static_cast<float>(i) * step);
+    }
+
+    __attribute__((target("avx2,fma")))
+    float sum_squares_avx2(const float* x, size_t n) {
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m256 v0 = _mm256_loadu_ps(x + i);
+            __m256 v1 = _mm256_loadu_ps(x + i + 8);
+            acc0 = _mm256_fmadd_ps(v0, v0, acc0);
+            acc1 = _mm256_fmadd_ps(v1, v1, acc1);
+        }
+        __m256 acc = _mm256_add_ps(acc0, acc1);
+        __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+        float lanes[4];
+        _mm_storeu_ps(lanes, sum);
+        return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sum_squares_scalar(x + i, n - i);
+    }
+
+    __attribute__((target("avx2,fma")))
+    void magnitude_avx2(const float* z, float* mag, size_t n) {
+        size_t k = 0;
+        for (; k + 8 <= n; k += 8) {
+            __m256 a = _mm256_loadu_ps(z + 2 * k);      // r0 i0 r1 i1 | r2 i2 r3 i3
+            __m256 b = _mm256_loadu_ps(z + 2 * k + 8);  // r4 i4 r5 i5 | r6 i6 r7 i7
+            __m256 re = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));  // r0 r1 r4 r5 | r2 r3 r6 r7
+            __m256 im = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+            __m256 power = _mm256_fmadd_ps(re, re, _mm256_mul_ps(im, im));
+            __m256 m = _mm256_sqrt_ps(power);
+            // Restore bin order across the 128-bit lanes
+            m = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(m), _MM_SHUFFLE(3, 1, 2, 0)));
+            _mm256_storeu_ps(mag + k, m);
+        }
+        magnitude_scalar(z + 2 * k, mag + k, n - k);
+    }
+
+    __attribute__((target("avx2,fma")))
+    void magnitude_to_db_avx2(const float* mag, float* out, size_t n, float min_db, float max_db) {
+        __m256 eps = _mm256_set1_ps(DB_EPSILON);
+        __m256 lo = _mm256_set1_ps(min_db);
+        __m256 hi = _mm256_set1_ps(max_db);
+        __m256 k_db = _mm256_set1_ps(DB_PER_LN);
+        size_t k = 0;
+        for (; k + 8 <= n; k += 8) {
+            __m256 db = _mm256_mul_ps(k_db, ln_avx2(_mm256_add_ps(_mm256_loadu_ps(mag + k), eps)));
+            _mm256_storeu_ps(out + k, _mm256_max_ps(lo, _mm256_min_ps(db, hi)));
+        }
+        magnitude_to_db_scalar(mag + k, out + k, n - k, min_db, max_db);
+    }
+
+    __attribute__((target("avx2,fma")))
+    void deinterleave_avx2(const float* in, float* const* out, size_t channels, size_t frames) {
+        if (channels != 2) return deinterleave_scalar(in, out, channels, frames);
+        float* left = out[0];
+        float* right = out[1];
+        size_t i = 0;
+        for (; i + 8 <= frames; i += 8) {
+            __m256 a = _mm256_loadu_ps(in + 2 * i);
+            __m256 b = _mm256_loadu_ps(in + 2 * i + 8);
+            __m256 l = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));  // L0 L1 L4 L5 | L2 L3 L6 L7
+            __m256 r = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+            l = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(l), _MM_SHUFFLE(3, 1, 2, 0)));
+            r = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(r), _MM_SHUFFLE(3, 1, 2, 0)));
+            _mm256_storeu_ps(left + i, l);
+            _mm256_storeu_ps(right + i, r);
+        }
+        float* rest[2] = {left + i, right + i};
+        deinterleave_scalar(in + 2 * i, rest, 2, frames - i);
+    }
+
+    __attribute__((target("avx2,fma")))
+    void interleave_avx2(const float* const* in, float* out, size_t channels, size_t frames) {
+        if (channels != 2) return interleave_scalar(in, out, channels, frames);
+        const float* left = in[0];
+        const float* right = in[1];
+        size_t i = 0;
+        for (; i + 8 <= frames; i += 8) {
+            __m256 l = _mm256_loadu_ps(left + i);
+            __m256 r = _mm256_loadu_ps(right + i);
+            __m256 lo = _mm256_unpacklo_ps(l, r);  // L0 R0 L1 R1 | L4 R4 L5 R5
+            __m256 hi = _mm256_unpackhi_ps(l, r);  // L2 R2 L3 R3 | L6 R6 L7 R7
+            _mm256_storeu_ps(out + 2 * i, _mm256_permute2f128_ps(lo, hi, 0x20));
+            _mm256_storeu_ps(out + 2 * i + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+        }
+        const float* rest[2] = {left + i, right + i};
+        interleave_scalar(rest, out + 2 * i, 2, frames - i);
+    }
+
+    __attribute__((target("avx2,fma")))
+    void s16_to_float_avx2(const int16_t* in, float* out, size_t n) {
+        __m256 k = _mm256_set1_ps(1.0f / S16_SCALE);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)));
+            _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), k));
+        }
+        s16_to_float_scalar(in + i, out + i, n - i);
+    }
+
+    __attribute__((target("avx2,fma")))
+    void float_to_s16_avx2(const float* in, int16_t* out, size_t n) {
+        __m256 k = _mm256_set1_ps(S16_SCALE);
+        __m256 lo = _mm256_set1_ps(-S16_SCALE);
+        __m256 hi = _mm256_set1_ps(S16_SCALE - 1.0f);
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m256 a = _mm256_max_ps(lo, _mm256_min_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i), k), hi));
+            __m256 b = _mm256_max_ps(lo, _mm256_min_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i + 8), k), hi));
+            // packs works per 128-bit lane: a0-3 b0-3 | a4-7 b4-7
+            __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+            packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), packed);
+        }
+        float_to_s16_scalar(in + i, out + i, n - i);
+    }
+
+    __attribute__((target("avx2,fma")))
+    void s32_to_float_avx2(const int32_t* in, float* out, size_t n, int bits) {
+        __m256 k = _mm256_set1_ps(1.0f / S32_SCALE);
+        __m128i shift = _mm_cvtsi32_si128(32 - bits);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i v = _mm256_sll_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i)), shift);
+            _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), k));
+        }
+        s32_to_float_scalar(in + i, out + i, n - i, bits);
+    }
+
+    __attribute__((target("avx2,fma")))
+    void float_to_s32_avx2(const float* in, int32_t* out, size_t n, int bits) {
+        __m256 k = _mm256_set1_ps(s32_full_scale(bits));
+        __m256 lo = _mm256_set1_ps(-s32_full_scale(bits));
+        __m256 hi = _mm256_set1_ps(s32_top(bits));
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256 v = _mm256_max_ps(lo, _mm256_min_ps(_mm256_mul_ps(_mm256_loadu_ps(in + i), k), hi));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_cvtps_epi32(v));
+        }
+        float_to_s32_scalar(in + i, out + i, n - i, bits);
+    }
+
+    // --------------------------------------------------------------- AVX-512
+
+    // GCC 12 flags the _mm512_undefined_*() placeholders inside its own
+    // intrinsics as uninitialised; the values are never read.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+    __attribute__((target("avx512f")))
+    inline __m512 ln_avx512(__m512 x) {
+        __m512i bits = _mm512_castps_si512(x);
+        __m512i e = _mm512_sub_epi32(_mm512_srli_epi32(bits, 23), _mm512_set1_epi32(127));
+        __m512 m = _mm512_castsi512_ps(_mm512_or_si512(_mm512_and_si512(bits, _mm512_set1_epi32(0x007FFFFF)),
+                                                       _mm512_set1_epi32(0x3F800000)));
+        __mmask16 big = _mm512_cmp_ps_mask(m, _mm512_set1_ps(SQRT2), _CMP_GT_OQ);
+        m = _mm512_mask_mul_ps(m, big, m, _mm512_set1_ps(0.5f));
+        __m512 ef = _mm512_mask_add_ps(_mm512_cvtepi32_ps(e), big, _mm512_cvtepi32_ps(e), _mm512_set1_ps(1.0f));
+
+        __m512 one = _mm512_set1_ps(1.0f);
+        __m512 t = _mm512_div_ps(_mm512_sub_ps(m, one), _mm512_add_ps(m, one));
+        __m512 t2 = _mm512_mul_ps(t, t);
+        __m512 p = _mm512_fmadd_ps(t2, _mm512_set1_ps(1.0f / 7.0f), _mm512_set1_ps(1.0f / 5.0f));
+        p = _mm512_fmadd_ps(t2, p, _mm512_set1_ps(1.0f / 3.0f));
+        p = _mm512_fmadd_ps(t2, p, one);
+        __m512 ln_m = _mm512_mul_ps(_mm512_add_ps(t, t), p);
+        return _mm512_fmadd_ps(ef, _mm512_set1_ps(LN2), ln_m);
+    }
+
+    __attribute__((target("avx512f")))
+    void multiply_avx512(const float* a, const float* b, float* out, size_t n) {
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            _mm512_storeu_ps(out + i, _mm512_mul_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i)));
+        }
+        multiply_scalar(a + i, b + i, out + i, n - i);
+    }
+
+    __attribute__((target("avx512f")))
+    void multiply_add_avx512(const float* a, const float* b, float* acc, size_t n) {
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            _mm512_storeu_ps(acc + i, _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i),
+                                                      _mm512_loadu_ps(acc + i)));
+        }
+        multiply_add_scalar(a + i, b + i, acc + i, n - i);
+    }
+
+    __attribute__((target("avx512f")))
+    void scale_avx512(const float* in, float gain, float* out, size_t n) {
+        __m512 g = _mm512_set1_ps(gain);
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            _mm512_storeu_ps(out + i, _mm512_mul_ps(_mm512_loadu_ps(in + i), g));
+        }
+        scale_scalar(in + i, gain, out + i, n - i);
+    }
+
+    __attribute__((target("avx512f")))
+    float sum_squares_avx512(const float* x, size_t n) {
+        __m512 acc0 = _mm512_setzero_ps();
+        __m512 acc1 = _mm512_setzero_ps();
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32) {
+            __m512 v0 = _mm512_loadu_ps(x + i);
+            __m512 v1 = _mm512_loadu_ps(x + i + 16);
+            acc0 = _mm512_fmadd_ps(v0, v0, acc0);
+            acc1 = _mm512_fmadd_ps(v1, v1, acc1);
+        }
+        return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1)) + sum_squares_scalar(x + i, n - i);
+    }
+
+    __attribute__((target("avx512f")))
+    void magnitude_avx512(const float* z, float* mag, size_t n) {
+        const __m512i even = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+        const __m512i odd = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+        size_t k = 0;
+        for (; k + 16 <= n; k += 16) {
+            __m512 a = _mm512_loadu_ps(z + 2 * k);
+            __m512 b = _mm512_loadu_ps(z + 2 * k + 16);
+            __m512 re = _mm512_permutex2var_ps(a, even, b);
+            __m512 im = _mm512_permutex2var_ps(a, odd, b);
+            __m512 power = _mm512_fmadd_ps(re, re, _mm512_mul_ps(im, im));
+            _mm512_storeu_ps(mag + k, _mm512_sqrt_ps(power));
+        }
+        magnitude_scalar(z + 2 * k, mag + k, n - k);
+    }
+
+    __attribute__((target("avx512f")))
+    void magnitude_to_db_avx512(const float* mag, float* out, size_t n, float min_db, float max_db) {
+        __m512 eps = _mm512_set1_ps(DB_EPSILON);
+        __m512 lo = _mm512_set1_ps(min_db);
+        __m512 hi = _mm512_set1_ps(max_db);
+        __m512 k_db = _mm512_set1_ps(DB_PER_LN);
+        size_t k = 0;
+        for (; k + 16 <= n; k += 16) {
+            __m512 db = _mm512_mul_ps(k_db, ln_avx512(_mm512_add_ps(_mm512_loadu_ps(mag + k), eps)));
+            _mm512_storeu_ps(out + k, _mm512_max_ps(lo, _mm512_min_ps(db, hi)));
+        }
+        magnitude_to_db_scalar(mag + k, out + k, n - k, min_db, max_db);
+    }
+#pragma GCC diagnostic pop
+#endif
+
+    // -------------------------------------------------------------- dispatch
+
+    struct Kernels {
+        simd::Level level;
+        void (*multiply)(const float*, const float*, float*, size_t);
+        void (*multiply_add)(const float*, const float*, float*, size_t);
+        void (*scale)(const float*, float, float*, size_t);
+        void (*scale_ramp)(const float*, float, float, float*, size_t);
+        float (*sum_squares)(const float*, size_t);
+        void (*magnitude)(const float*, float*, size_t);
+        void (*magnitude_to_db)(const float*, float*, size_t, float, float);
+        void (*deinterleave)(const float*, float* const*, size_t, size_t);
+        void (*interleave)(const float* const*, float*, size_t, size_t);
+        void (*s16_to_float)(const int16_t*, float*, size_t);
+        void (*float_to_s16)(const float*, int16_t*, size_t);
+        void (*s32_to_float)(const int32_t*, float*, size_t, int);
+        void (*float_to_s32)(const float*, int32_t*, size_t, int);
+    };
+
+    const Kernels SCALAR_KERNELS = {
+        simd::Level::SCALAR, multiply_scalar, multiply_add_scalar, scale_scalar, scale_ramp_scalar,
+        sum_squares_scalar, magnitude_scalar, magnitude_to_db_scalar,
+        deinterleave_scalar, interleave_scalar,
+        s16_to_float_scalar, float_to_s16_scalar, s32_to_float_scalar, float_to_s32_scalar
+    };
+
+#ifdef VOCODER_SIMD_X86
+    const Kernels SSE2_KERNELS = {
+        simd::Level::SSE2, multiply_sse2, multiply_add_sse2, scale_sse2, scale_ramp_sse2,
+        sum_squares_sse2, magnitude_sse2, magnitude_to_db_sse2,
+        deinterleave_sse2, interleave_sse2,
+        s16_to_float_sse2, float_to_s16_sse2, s32_to_float_sse2, float_to_s32_sse2
+    };
+
+    const Kernels AVX2_KERNELS = {
+        simd::Level::AVX2, multiply_avx2, multiply_add_avx2, scale_avx2, scale_ramp_avx2,
+        sum_squares_avx2, magnitude_avx2, magnitude_to_db_avx2,
+        deinterleave_avx2, interleave_avx2,
+        s16_to_float_avx2, float_to_s16_avx2, s32_to_float_avx2, float_to_s32_avx2
+    };
+
+    const Kernels AVX512_KERNELS = {
+        simd::Level::AVX512, multiply_avx512, multiply_add_avx512, scale_avx512, scale_ramp_avx2,
+        sum_squares_avx512, magnitude_avx512, magnitude_to_db_avx512,
+        deinterleave_avx2, interleave_avx2,
+        s16_to_float_avx2, float_to_s16_avx2, s32_to_float_avx2, float_to_s32_avx2
+    };
+#endif
+
+    const Kernels* kernels_for(simd::Level level) {
+        switch (level) {
+#ifdef VOCODER_SIMD_X86
+            case simd::Level::AVX512: return &AVX512_KERNELS;
+            case simd::Level::AVX2:   return &AVX2_KERNELS;
+            case simd::Level::SSE2:   return &SSE2_KERNELS;
+#endif
+            default:                  return &SCALAR_KERNELS;
+        }
+    }
+
+    std::atomic<const Kernels*> g_kernels{kernels_for(simd::detected_level())};
+}
+
+namespace simd {
+
+Level detected_level() {
+#ifdef VOCODER_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return Level::AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return Level::AVX2;
+    if (__builtin_cpu_supports("sse2")) return Level::SSE2;
+#endif
+    return Level::SCALAR;
+}
+
+Level active_level() {
+    return g_kernels.load(std::memory_order_relaxed)->level;
+}
+
+bool set_level(Level level) {
+    if (level > detected_level()) return false;
+    g_kernels.store(kernels_for(level), std::memory_order_relaxed);
+    return true;
+}
+
+const char* level_name(Level level) {
+    switch (level) {
+        case Level::AVX512: return "avx512";
+        case Level::AVX2:   return "avx2";
+        case Level::SSE2:   return "sse2";
+        case Level::SCALAR:
+        default:            return "scalar";
+    }
+}
+
+void multiply(const float* a, const float* b, float* out, size_t n) {
+    g_kernels.load(std::memory_order_relaxed)->multiply(a, b, out, n);
+}
+
+void multiply_add(const float* a, const float* b, float* acc, size_t n) {
+    g_kernels.load(std::memory_order_relaxed)->multiply_add(a, b, acc, n);
+}
+
+void scale(const float* in, float gain, float* out, size_t n) {
+    g_kernels.load(std::memory_order_relaxed)->scale(in, gain, out, n);
+}
+
+void scale_ramp(const float* in, float start, float step, float* out, size_t n) {
+    g_kernels.load(std::memory_order_relaxed)->scale_ramp(in, start, step, out, n);
+}
+
+float sum_squares(const float* x, size_t n) {
+    return g_kernels.load(std::memory_order_relaxed)->sum_squares(x, n);
+}
+
+void magnitude(const float* complex, float* mag, size_t n) {
+    g_kernels.load(std::memory_order_relaxed)->magnitude(complex, mag, n);
+}
+
+void magnitude_to_db(const float* mag, float* out_db, size_t n, float min_db, float max_db) {
+    g_kernels.load(std::memory_order_relaxed)->magnitude_to_db(mag, out_db, n, min_db, max_db);
+}
+
+void deinterleave(const float* in, float* const* out, size_t channels, size_t frames) {
+    g_kernels.load(std::memory_order_relaxed)->deinterleave(in, out, channels, frames);
+}
+
+void interleave(const float* const* in, float* out, size_t channels, size_t frames) {
+    g_kernels.load(std::memory_order_relaxed)->interleave(in, out, channels, frames);
+}
+
+void s16_to_float(const int16_t* in, float* out, size_t n) {
+    g_kernels.load(std::memory_order_relaxed)->s16_to_float(in, out, n);
+}
+
+void float_to_s16(const float* in, int16_t* out, size_t n) {
+    g_kernels.load(std::memory_order_relaxed)->float_to_s16(in, out, n);
+}
+
+void s32_to_float(const int32_t* in, float* out, size_t n, int bits) {
+    g_kernels.load(std::memory_order_relaxed)->s32_to_float(in, out, n, bits);
+}
+
+void float_to_s32(const float* in, int32_t* out, size_t n, int bits) {
+    g_kernels.load(std::memory_order_relaxed)->float_to_s32(in, out, n, bits);
+}
+
+}
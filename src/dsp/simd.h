@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Vectorised kernels for the per-sample and per-bin hot loops.
+// The best instruction set (AVX-512, AVX2, SSE2) is picked at runtime; the
+// scalar level is the reference implementation. Vector results match it to
+// within float rounding (products, sums) and 1e-3 dB (magnitude_to_db, which
+// uses a polynomial log approximation instead of std::log10).
+namespace simd {
+
+enum class Level {
+    SCALAR,
+    SSE2,
+    AVX2,
+    AVX512
+};
+
+Level detected_level();
+Level active_level();
+// Force a level (e.g. SCALAR for comparisons); false if the CPU lacks it
+bool set_level(Level level);
+const char* level_name(Level level);
+
+// out[i] = a[i] * b[i]
+void multiply(const float* a, const float* b, float* out, size_t n);
+// acc[i] += a[i] * b[i]
+void multiply_add(const float* a, const float* b, float* acc, size_t n);
+// out[i] = in[i] * gain
+void scale(const float* in, float gain, float* out, size_t n);
+// out[i] = in[i] * (start + i * step), a linear gain ramp
+void scale_ramp(const float* in, float start, float step, float* out, size_t n);
+// sum of x[i]^2
+float sum_squares(const float* x, size_t n);
+// mag[k] = |z[k]| for interleaved complex input (re, im, re, im, ...)
+void magnitude(const float* complex, float* mag, size_t n);
+// out[k] = 20 * log10(mag[k] + 1e-10), clamped to [min_db, max_db]
+void magnitude_to_db(const float* mag, float* out_db, size_t n, float min_db, float max_db);
+// Split interleaved frames into per-channel planes, and back
+void deinterleave(const float* in, float* const* out, size_t channels, size_t frames);
+void interleave(const float* const* in, float* out, size_t channels, size_t frames);
+// Integer samples <-> float in [-1, 1). Float to integer rounds to nearest and
+// saturates. bits is 32, or 24 for 24-bit samples in the low bits of 32.
+void s16_to_float(const int16_t* in, float* out, size_t n);
+void float_to_s16(const float* in, int16_t* out, size_t n);
+void s32_to_float(const int32_t* in, float* out, size_t n, int bits);
+void float_to_s32(const float* in, int32_t* out, size_t n, int bits);
+
+}
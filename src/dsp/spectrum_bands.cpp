@@ -0,0 +1,35 @@
+#include "dsp/spectrum_bands.h"
+#include "dsp/simd.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    constexpr float POWER_EPSILON = 1e-20f;  // -200 dB, keeps log10 finite
+}
+
+SpectrumBands::SpectrumBands(size_t fft_size, int sample_rate, size_t bands, float min_freq, float max_freq)
+    : min_freq_(min_freq), max_freq_(std::min(max_freq, sample_rate / 2.0f)),
+      first_bin_(bands), end_bin_(bands) {
+    max_freq = max_freq_;
+    const size_t last_bin = fft_size / 2;
+    const double bin_hz = static_cast<double>(sample_rate) / fft_size;
+
+    auto nearest_bin = [&](double freq) {
+        return std::min(static_cast<size_t>(std::lround(freq / bin_hz)), last_bin);
+    };
+
+    for (size_t b = 0; b < bands; b++) {
+        double low = min_freq * std::pow(static_cast<double>(max_freq) / min_freq, static_cast<double>(b) / bands);
+        double high = min_freq * std::pow(static_cast<double>(max_freq) / min_freq, static_cast<double>(b + 1) / bands);
+        first_bin_[b] = nearest_bin(low);
+        end_bin_[b] = std::max(first_bin_[b] + 1, nearest_bin(high));
+    }
+}
+
+void SpectrumBands::compute(const float* magnitude, float* band_db) const {
+    for (size_t b = 0; b < first_bin_.size(); b++) {
+        float power = simd::sum_squares(magnitude + first_bin_[b], end_bin_[b] - first_bin_[b]);
+        float db = 10.0f * std::log10(power + POWER_EPSILON);
+        band_db[b] = std::max(SPECTRUM_MIN_DB, std::min(db, SPECTRUM_MAX_DB));
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "config.h"
+
+// Maps FFT bins onto log-spaced display bands between min_freq and max_freq.
+// The bin range of every band is worked out once; compute() then sums the
+// power of each band's bins and takes a single log per band. Every bin in
+// range contributes, so narrow tones between two bar frequencies still show
+// up. Low bands narrower than a bin share their nearest bin. max_freq is
+// capped at the Nyquist frequency.
+class SpectrumBands {
+public:
+    SpectrumBands(size_t fft_size, int sample_rate, size_t bands = SPECTRUM_BARS,
+                  float min_freq = SPECTRUM_MIN_FREQ, float max_freq = SPECTRUM_MAX_FREQ);
+
+    // magnitude holds fft_size / 2 + 1 bins; band_db receives bands() values
+    // in dB, clamped to [SPECTRUM_MIN_DB, SPECTRUM_MAX_DB]
+    void compute(const float* magnitude, float* band_db) const;
+
+    size_t bands() const { return first_bin_.size(); }
+    size_t first_bin(size_t band) const { return first_bin_[band]; }
+    size_t end_bin(size_t band) const { return end_bin_[band]; }
+    float min_freq() const { return min_freq_; }
+    float max_freq() const { return max_freq_; }
+
+private:
+    float min_freq_;
+    float max_freq_;
+    std::vector<size_t> first_bin_;  // band b covers bins [first_bin_[b], end_bin_[b])
+    std::vector<size_t> end_bin_;
+};
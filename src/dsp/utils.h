@@ -1,13 +1,12 @@
 #pragma once
 
+#include <algorithm>
 #include <cmath>
+#include "dsp/simd.h"
 
 inline float calculate_db(const float* buffer, int frames) {
     if (frames <= 0) return -60.0f;
-    float sum = 0.0f;
-    for (int i = 0; i < frames; i++) {
-        sum += buffer[i] * buffer[i];
-    }
+    float sum = simd::sum_squares(buffer, static_cast<size_t>(frames));
     float rms = std::sqrt(sum / frames);
     if (rms > 0.0f) {
         float db = 20.0f * std::log10(rms);
@@ -0,0 +1,197 @@
+#include "dsp/wsola.h"
+#include "dsp/simd.h"
+#include "utils/trace.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // The read head stays between these distances behind the newest sample.
+    // MIN_DELAY leaves room to read a full overlap ahead of the head; a jump
+    // of at most JUMP + SEARCH from either end lands back inside the range.
+    constexpr size_t MIN_DELAY = WSOLA_OVERLAP + 8;
+    constexpr size_t MAX_DELAY = MIN_DELAY + WSOLA_JUMP + WSOLA_SEARCH + WSOLA_OVERLAP;
+    constexpr size_t NOMINAL_DELAY = (MIN_DELAY + MAX_DELAY) / 2;
+
+    size_t ring_size(size_t spectrum_size) {
+        size_t needed = std::max(spectrum_size, MAX_DELAY + WSOLA_JUMP + WSOLA_SEARCH + 4 * WSOLA_OVERLAP);
+        size_t size = 1;
+        while (size < needed) size *= 2;
+        return size;
+    }
+}
+
+WsolaShifter::WsolaShifter(size_t spectrum_size)
+    : mask_(ring_size(spectrum_size) - 1), idle_(true),
+      reference_(nullptr),
+      history_(mask_ + 1),
+      written_(0), head_(0.0), next_head_(0.0), fade_pos_(0), fading_(false),
+      plan_head_(SHIFT_CHUNK_FRAMES), plan_next_(SHIFT_CHUNK_FRAMES), plan_gain_(SHIFT_CHUNK_FRAMES),
+      reference_segment_(WSOLA_OVERLAP),
+      candidates_(2 * WSOLA_SEARCH + WSOLA_OVERLAP),
+      spectrum_size_(spectrum_size),
+      fft_(std::make_unique<FFTProcessor>(spectrum_size)),
+      window_(spectrum_size),
+      magnitude_(spectrum_size / 2 + 1) {
+
+    for (size_t i = 0; i < spectrum_size; i++) {
+        window_[i] = 0.5f * (1.0f - std::cos(2.0f * M_PI * i / spectrum_size));
+    }
+    reset();
+}
+
+WsolaShifter::~WsolaShifter() = default;
+
+void WsolaShifter::set_pitch_ratio(float ratio) {
+    pitch_.set(std::max(0.25f, std::min(ratio, 4.0f)), PITCH_GLIDE_FRAMES);
+    if (idle_) pitch_.snap();
+}
+
+void WsolaShifter::set_volume(float vol) {
+    gain_.set(std::max(0.0f, std::min(vol, 1.0f)));
+    if (idle_) gain_.snap();
+}
+
+void WsolaShifter::reset() {
+    std::fill(history_.begin(), history_.end(), 0.0f);
+    // Start a full ring in, so positions behind the head stay positive
+    written_ = history_.size();
+    head_ = static_cast<double>(written_ - NOMINAL_DELAY);
+    next_head_ = head_;
+    fade_pos_ = 0;
+    fading_ = false;
+    pitch_.snap();
+    gain_.snap();
+    idle_ = true;
+}
+
+size_t WsolaShifter::prefault() {
+    reset();
+    std::fill(plan_head_.begin(), plan_head_.end(), 0.0);
+    std::fill(plan_next_.begin(), plan_next_.end(), 0.0);
+    std::fill(plan_gain_.begin(), plan_gain_.end(), 0.0f);
+    std::fill(reference_segment_.begin(), reference_segment_.end(), 0.0f);
+    std::fill(candidates_.begin(), candidates_.end(), 0.0f);
+    std::fill(magnitude_.begin(), magnitude_.end(), 0.0f);
+    return fft_->prefault() +
+           (history_.size() + reference_segment_.size() + candidates_.size() + window_.size() + magnitude_.size() +
+            plan_gain_.size()) * sizeof(float) +
+           (plan_head_.size() + plan_next_.size()) * sizeof(double);
+}
+
+size_t WsolaShifter::latency_samples() const {
+    return NOMINAL_DELAY;
+}
+
+// Linear interpolation; pos is at least MIN_DELAY behind the newest sample
+float WsolaShifter::read(double pos) const {
+    uint64_t index = static_cast<uint64_t>(pos);
+    float frac = static_cast<float>(pos - static_cast<double>(index));
+    float a = history_[index & mask_];
+    float b = history_[(index + 1) & mask_];
+    return a + frac * (b - a);
+}
+
+// Pick the jump target (direction -1: back, +1: forward) whose next
+// WSOLA_OVERLAP samples correlate best with the head's, and start fading
+void WsolaShifter::start_splice(double direction) {
+    uint64_t from = static_cast<uint64_t>(head_);
+    uint64_t base = from + static_cast<int64_t>(direction * WSOLA_JUMP) - WSOLA_SEARCH;
+
+    for (size_t i = 0; i < WSOLA_OVERLAP; i++) {
+        reference_segment_[i] = history_[(from + i) & mask_];
+    }
+    for (size_t i = 0; i < candidates_.size(); i++) {
+        candidates_[i] = history_[(base + i) & mask_];
+    }
+
+    // Normalised cross-correlation; the candidate energy slides along
+    float energy = simd::sum_squares(candidates_.data(), WSOLA_OVERLAP);
+    float best_score = -1e30f;
+    size_t best = WSOLA_SEARCH;
+    for (size_t k = 0; k <= 2 * WSOLA_SEARCH; k++) {
+        float dot = 0.0f;
+        for (size_t i = 0; i < WSOLA_OVERLAP; i++) {
+            dot += reference_segment_[i] * candidates_[k + i];
+        }
+        float score = dot / std::sqrt(energy + 1e-9f);
+        if (score > best_score) {
+            best_score = score;
+            best = k;
+        }
+        if (k < 2 * WSOLA_SEARCH) {
+            energy += candidates_[k + WSOLA_OVERLAP] * candidates_[k + WSOLA_OVERLAP] - candidates_[k] * candidates_[k];
+            energy = std::max(energy, 0.0f);
+        }
+    }
+
+    next_head_ = static_cast<double>(base + best) + (head_ - static_cast<double>(from));
+    fade_pos_ = 0;
+    fading_ = true;
+}
+
+void WsolaShifter::process(const float* input, float* output, int num_frames) {
+    TRACE_SCOPE("wsola");
+    idle_ = false;
+    const bool follow = reference_ != nullptr;
+
+    for (int i = 0; i < num_frames; i++) {
+        const double ratio = pitch_.next();
+        const float level = gain_.next();
+        history_[written_ & mask_] = input[i];
+        written_++;
+
+        if (follow && static_cast<size_t>(i) < plan_head_.size()) {
+            head_ = reference_->plan_head_[i];
+            next_head_ = reference_->plan_next_[i];
+            fading_ = reference_->plan_gain_[i] >= 0.0f;
+            float gain = reference_->plan_gain_[i];
+            float y = read(head_);
+            if (fading_) y += gain * (read(next_head_) - y);
+            output[i] = y * level;
+            continue;
+        }
+
+        if (!fading_) {
+            double delay = static_cast<double>(written_) - head_;
+            if (ratio > 1.0 && delay < MIN_DELAY + (ratio - 1.0) * WSOLA_OVERLAP) {
+                start_splice(-1.0);
+            } else if (ratio < 1.0 && delay > MAX_DELAY - (1.0 - ratio) * WSOLA_OVERLAP) {
+                start_splice(1.0);
+            }
+        }
+
+        float gain = -1.0f;
+        float y = read(head_);
+        if (fading_) {
+            gain = static_cast<float>(fade_pos_ + 1) / WSOLA_OVERLAP;
+            y += gain * (read(next_head_) - y);
+        }
+        output[i] = y * level;
+
+        if (static_cast<size_t>(i) < plan_head_.size()) {
+            plan_head_[i] = head_;
+            plan_next_[i] = next_head_;
+            plan_gain_[i] = gain;
+        }
+
+        head_ += ratio;
+        if (fading_) {
+            next_head_ += ratio;
+            if (++fade_pos_ == WSOLA_OVERLAP) {
+                head_ = next_head_;
+                fading_ = false;
+            }
+        }
+    }
+}
+
+void WsolaShifter::get_spectrum(const SpectrumBands& bands, float* band_db) {
+    uint64_t first = written_ - spectrum_size_;
+    float* frame = fft_->time_buffer();
+    for (size_t i = 0; i < spectrum_size_; i++) {
+        frame[i] = history_[(first + i) & mask_] * window_[i];
+    }
+    fft_->execute_forward();
+    simd::magnitude(&fft_->spectrum()[0][0], magnitude_.data(), magnitude_.size());
+    bands.compute(magnitude_.data(), band_db);
+}
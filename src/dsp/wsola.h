@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "dsp/fft.h"
+#include "dsp/ramp.h"
+#include "dsp/shifter.h"
+#include "config.h"
+
+// Low-latency time-domain pitch shifter (WSOLA-style splicing).
+// Input goes into a short history ring. A read head plays it back at
+// pitch_ratio times the input rate. The distance between the read head and
+// the newest sample then shrinks (ratio > 1) or grows (ratio < 1). Before it
+// leaves [min, max delay], the head jumps by about WSOLA_JUMP samples to the
+// offset within +-WSOLA_SEARCH whose waveform best matches what it is about
+// to play, and crossfades there over WSOLA_OVERLAP samples. Latency is the
+// read delay, a few milliseconds instead of the phase vocoder's FFT_SIZE.
+//
+// The spectrum for display is taken from the last spectrum_size input
+// samples on demand, so the FFT only runs when get_spectrum() is called.
+class WsolaShifter : public Shifter {
+public:
+    explicit WsolaShifter(size_t spectrum_size);
+    ~WsolaShifter() override;
+
+    void set_pitch_ratio(float ratio) override;
+    float get_pitch_ratio() const override { return pitch_.target(); }
+
+    void set_volume(float vol) override;
+    float get_volume() const override { return gain_.target(); }
+
+    void process(const float* input, float* output, int num_frames) override;
+    void get_spectrum(const SpectrumBands& bands, float* band_db) override;
+    void reset() override;
+    size_t prefault() override;
+
+    size_t latency_samples() const override;
+    size_t hop_size() const override { return SHIFT_CHUNK_FRAMES; }
+
+    // Follow the reference channel's read heads instead of searching, so all
+    // channels splice at the same points and the stereo image holds. The
+    // reference must process the same frames just before this shifter does.
+    void set_reference(const WsolaShifter* reference) { reference_ = reference; }
+
+private:
+    float read(double pos) const;
+    void start_splice(double direction);
+
+    size_t mask_;
+    PitchGlide pitch_;  // one step per sample
+    GainRamp gain_;
+    bool idle_;         // nothing processed since reset(): changes snap
+    const WsolaShifter* reference_;
+
+    std::vector<float> history_;  // power-of-two ring, indexed by absolute sample count
+    uint64_t written_;            // samples written; the newest is written_ - 1
+
+    // Read heads, as absolute sample positions. While fading, output moves
+    // from head_ to next_head_ over WSOLA_OVERLAP samples.
+    double head_;
+    double next_head_;
+    size_t fade_pos_;
+    bool fading_;
+
+    // Heads and crossfade gain of every frame of the last process() call
+    // (up to SHIFT_CHUNK_FRAMES), for channels following this one
+    std::vector<double> plan_head_;
+    std::vector<double> plan_next_;
+    std::vector<float> plan_gain_;  // < 0 when not fading
+
+    // Splice search scratch
+    std::vector<float> reference_segment_;
+    std::vector<float> candidates_;
+
+    // Display spectrum
+    size_t spectrum_size_;
+    std::unique_ptr<FFTProcessor> fft_;
+    std::vector<float> window_;
+    std::vector<float> magnitude_;
+};
@@ -1,13 +1,29 @@
 #include <iostream>
 #include <csignal>
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <cstdio>
 #include <cstring>
+#include <memory>
+#include <thread>
 #include <vector>
 #include "audio/alsa.h"
-#include "dsp/pitchshift.h"
+#include "audio/batch.h"
+#include "audio/calibrate.h"
+#include "audio/engine.h"
+#include "audio/null_backend.h"
+#include "audio/wav_file.h"
+#include "dsp/multichannel.h"
+#include "dsp/simd.h"
 #include "dsp/utils.h"
 #include "ui/tui.h"
+#include "utils/alloc_check.h"
 #include "utils/logger.h"
+#include "utils/metrics.h"
+#include "utils/options.h"
+#include "utils/realtime.h"
+#include "utils/trace.h"
 #include "config.h"
 
 namespace {
@@ -19,89 +35,356 @@ void signal_handler(int signal) {
     running = false;
 }
 
-int main() {
+void trace_signal_handler(int signal) {
+    (void)signal;
+    Tracer::instance().request_dump("signal");
+}
+
+namespace {
+    std::unique_ptr<AudioBackend> create_backend(const Options& opts) {
+        switch (opts.backend) {
+            case BackendType::FILE:
+                return std::make_unique<WavFileBackend>(opts.channels);
+            case BackendType::NULL_TONE:
+                return std::make_unique<NullBackend>(opts.audio.sample_rate, opts.channels, 440.0f,
+                    static_cast<size_t>(opts.seconds * opts.audio.sample_rate));
+            case BackendType::ALSA:
+            default:
+            {
+                auto device = std::make_unique<ALSADevice>(opts.channels, opts.period_size, opts.periods,
+                                                           opts.audio.sample_rate, opts.audio.sample_format);
+                device->set_drift_compensation(opts.drift_compensation);
+                return device;
+            }
+        }
+    }
+
+    // Finds the lowest stable ALSA period for this device pair and setup
+    // and caches it for later starts.
+    int run_calibration(const Options& opts) {
+        std::printf("Calibrating %s -> %s, %.0f s per period size...\n", opts.capture_device.c_str(),
+                    opts.playback_device.c_str(), CALIBRATE_SECONDS);
+        LatencyCalibrator calibrator(opts.capture_device, opts.playback_device, opts.channels,
+                                     static_cast<unsigned int>(opts.periods), opts.audio);
+        LatencySetting setting;
+        if (!calibrator.run(running, setting)) {
+            std::cerr << "No stable period size found" << std::endl;
+            return 1;
+        }
+
+        std::printf("Using period %lu x %u (%.2f ms buffer), saved for this device pair and setup\n",
+                    setting.period_size, setting.periods,
+                    1000.0 * setting.period_size * setting.periods / opts.audio.sample_rate);
+        return LatencyCalibrator::save(opts.wisdom_dir, opts.capture_device, opts.playback_device, opts.channels,
+                                       opts.audio, setting) ? 0 : 1;
+    }
+
+    int run_batch(const Options& opts) {
+        BatchProcessor batch(opts.pitch_ratio, opts.phase_lock, opts.audio, static_cast<size_t>(opts.jobs));
+        bool inputs_ok = true;
+        for (const std::string& input : opts.batch_inputs) {
+            inputs_ok = batch.add_input(input) && inputs_ok;
+        }
+        if (batch.file_count() == 0) {
+            std::cerr << "No WAV files to process" << std::endl;
+            return 1;
+        }
+        batch.set_output_dir(opts.output_dir);
+
+        bool ok = batch.run(running);
+        batch.print_report();
+        return (ok && inputs_ok) ? 0 : 1;
+    }
+
+    // Process-wide part of real-time mode; the threads do the rest
+    void prepare_realtime(const RealtimeConfig& config, MultiChannelShifter& shifter, RealtimeReport& report) {
+        if (!config.enabled) return;
+        report.requested = true;
+        report.memory_error = Realtime::lock_memory();
+        report.prefaulted_bytes = shifter.prefault();
+        report.workers_fifo_error = shifter.set_worker_realtime(config.priority);
+    }
+
+    // Runs the full capture -> process -> playback chain as fast as the
+    // backend allows and reports throughput. With align (file output), the
+    // DSP latency is trimmed from the start and the input is padded with
+    // silence at the end, like batch jobs, so the output lines up with the
+    // input and has the same length.
+    int run_headless(AudioBackend& audio, MultiChannelShifter& shifter, int block_frames,
+                     const RealtimeConfig& realtime, AudioMetrics* metrics, bool align) {
+        std::vector<float> input_buffer(static_cast<size_t>(block_frames) * audio.get_channels());
+        std::vector<float> output_buffer(static_cast<size_t>(block_frames) * audio.get_channels());
+        RealtimeReport report;
+        prepare_realtime(realtime, shifter, report);
+        if (realtime.enabled) {
+            Realtime::enter_audio_thread(realtime, report);
+            std::printf("%s", Realtime::describe(report).c_str());
+            LOG_INFO(Realtime::describe(report));
+        }
+        TRACE_THREAD("audio");
+        AllocCheck::watch_thread();
+
+        using clock = std::chrono::steady_clock;
+        size_t total_frames = 0;
+        size_t blocks = 0;
+        double block_sum_ms = 0.0;
+        double block_max_ms = 0.0;
+        const int channels = audio.get_channels();
+        size_t skip = align ? shifter.latency_samples() : 0;
+        size_t flush = skip;  // frames of silence still to push through
+
+        auto start = clock::now();
+        while (running && (!audio.finished() || flush > 0)) {
+            auto block_start = clock::now();
+
+            int captured;
+            if (audio.finished()) {
+                captured = static_cast<int>(std::min(flush, static_cast<size_t>(block_frames)));
+                std::fill(input_buffer.begin(), input_buffer.end(), 0.0f);
+                flush -= static_cast<size_t>(captured);
+            } else {
+                bool ready;
+                {
+                    TRACE_SCOPE("capture_wait");
+                    ready = audio.wait(AUDIO_WAIT_TIMEOUT_MS);
+                }
+                if (!ready) {
+                    continue;
+                }
+                {
+                    TRACE_SCOPE("capture");
+                    captured = audio.capture(input_buffer.data(), block_frames);
+                }
+                if (captured <= 0) {
+                    continue;
+                }
+            }
+            {
+                TRACE_SCOPE("process");
+                shifter.process(input_buffer.data(), output_buffer.data(), captured);
+            }
+            size_t offset = std::min(skip, static_cast<size_t>(captured));
+            skip -= offset;
+            if (offset < static_cast<size_t>(captured)) {
+                TRACE_SCOPE("playback");
+                audio.playback(output_buffer.data() + offset * channels, captured - static_cast<int>(offset));
+            }
+
+            double ms = std::chrono::duration<double, std::milli>(clock::now() - block_start).count();
+            if (metrics) {
+                metrics->update(captured, ms * 1e-3,
+                                calculate_db(input_buffer.data(), captured * channels),
+                                calculate_db(output_buffer.data(), captured * channels));
+            }
+            block_sum_ms += ms;
+            block_max_ms = std::max(block_max_ms, ms);
+            total_frames += captured;
+            if (++blocks == ALLOC_CHECK_WARMUP_BLOCKS) {
+                AllocCheck::arm();
+            }
+        }
+        double wall = std::chrono::duration<double>(clock::now() - start).count();
+        AllocCheck::unwatch_thread();
+
+        if (blocks == 0) {
+            std::cerr << "No audio processed" << std::endl;
+            return 1;
+        }
+
+        int rate = audio.get_sample_rate();
+        double audio_seconds = static_cast<double>(total_frames) / rate;
+        double deadline_ms = 1000.0 * block_frames / rate;
+        double mean_ms = block_sum_ms / blocks;
+        double rtf = wall / audio_seconds;
+
+        std::printf("Processed %zu frames (%.2f s of audio) in %.3f s\n", total_frames, audio_seconds, wall);
+        std::printf("  real-time factor: %.4f (%.1fx real time)\n", rtf, 1.0 / rtf);
+        std::printf("  per block (%d frames, deadline %.2f ms): mean %.3f ms, max %.3f ms, load %.1f%%\n",
+                    block_frames, deadline_ms, mean_ms, block_max_ms, 100.0 * mean_ms / deadline_ms);
+        std::printf("  channels: %zu (%s%s)\n", shifter.channels(), shifter.parallel() ? "parallel" : "serial",
+                    shifter.pipelined() ? ", pipelined STFT" : "");
+        std::printf("  DSP latency: %zu samples (%.1f ms, %s)\n", shifter.latency_samples(),
+                    1000.0 * shifter.latency_samples() / rate, MultiChannelShifter::engine_name(shifter.engine()));
+        AllocCheck::report();
+        return AllocCheck::count() == 0 ? 0 : 1;
+    }
+}
+
+int main(int argc, char** argv) {
+    Options opts;
+    if (!parse_options(argc, argv, opts)) {
+        return 1;
+    }
+
     Logger::instance().set_file("/tmp/vocoder-tui.log");
     Logger::instance().set_level(LogLevel::INFO);
 
     std::signal(SIGINT, signal_handler);
     std::signal(SIGTERM, signal_handler);
+    std::signal(SIGUSR1, trace_signal_handler);
 
     LOG_INFO("Vocoder-TUI v1.0.0 starting...");
     LOG_INFO("Press 'q' to quit");
 
-    ALSADevice audio;
-    if (!audio.open_capture()) {
-        LOG_ERROR("Failed to open capture device");
+    if (!opts.batch_inputs.empty()) {
+        LOG_INFO(std::string("SIMD kernels: ") + simd::level_name(simd::active_level()));
+        FFTProcessor::configure_planning(opts.fft_effort, opts.wisdom_dir);
+        int rc = run_batch(opts);
+        LOG_INFO("Goodbye!");
+        return rc;
+    }
+
+    MetricsExporter metrics_exporter;
+    if (!opts.metrics_target.empty() && !metrics_exporter.start(opts.metrics_target)) {
         return 1;
     }
-    LOG_INFO("Capture device opened");
+    if (!opts.trace_dir.empty() && !Tracer::instance().start(opts.trace_dir)) {
+        return 1;
+    }
+
+    if (opts.calibrate) {
+        int rc = run_calibration(opts);
+        LOG_INFO("Goodbye!");
+        return rc;
+    }
+
+    // Use this machine's calibrated period unless one was given
+    LatencySetting latency;
+    if (opts.backend == BackendType::ALSA && opts.period_size == 0 &&
+        LatencyCalibrator::load(opts.wisdom_dir, opts.capture_device, opts.playback_device, opts.channels,
+                                opts.audio, latency)) {
+        opts.period_size = static_cast<int>(latency.period_size);
+        if (opts.periods == 0) opts.periods = static_cast<int>(latency.periods);
+        LOG_INFO("Calibrated period: " + std::to_string(opts.period_size) + " x " + std::to_string(opts.periods));
+    }
 
-    if (!audio.open_playback()) {
-        LOG_ERROR("Failed to open playback device");
+    std::unique_ptr<AudioBackend> backend = create_backend(opts);
+    AudioBackend& audio = *backend;
+    if (!audio.open_capture(opts.capture_device.c_str())) {
+        LOG_ERROR("Failed to open capture device");
         return 1;
     }
-    LOG_INFO("Playback device opened");
+    LOG_INFO("Capture device opened");
 
-    PitchShifter shifter(FFT_SIZE, HOP_SIZE, SAMPLE_RATE);
-    TUI ui;
-    ui.init();
+    // Headless file runs may skip the output file
+    if (!opts.playback_device.empty()) {
+        if (!audio.open_playback(opts.playback_device.c_str())) {
+            LOG_ERROR("Failed to open playback device");
+            return 1;
+        }
+        LOG_INFO("Playback device opened");
+    }
 
-    std::vector<float> input_buffer(BUFFER_FRAMES);
-    std::vector<float> output_buffer(BUFFER_FRAMES);
-    const size_t spectrum_bins = FFT_SIZE / 2 + 1;
+    LOG_INFO(std::string("SIMD kernels: ") + simd::level_name(simd::active_level()));
+    FFTProcessor::configure_planning(opts.fft_effort, opts.wisdom_dir);
+    MultiChannelShifter shifter(audio.get_channels(), opts.audio.fft_size, opts.audio.hop_size,
+                                audio.get_sample_rate(), opts.phase_lock);
+    LOG_INFO("Channels: " + std::to_string(shifter.channels()) +
+             (shifter.parallel() ? " (parallel)" : "") + (opts.phase_lock ? " phase-locked" : ""));
+    shifter.set_pitch_ratio(opts.pitch_ratio);
+    shifter.set_engine(opts.shift_engine);
+    LOG_INFO(std::string("Shift engine: ") + MultiChannelShifter::engine_name(opts.shift_engine));
+    if (opts.pipeline) {
+        if (!shifter.set_pipelined(true)) {
+            return 1;
+        }
+        LOG_INFO("Pipelined STFT: analysis and synthesis on separate threads");
+    }
+    LOG_INFOF("Stream: %d Hz, FFT %zu, hop %zu, block %d frames (%s kernel)", audio.get_sample_rate(),
+              opts.audio.fft_size, opts.audio.hop_size, opts.audio.block_frames,
+              PitchShifter::has_fixed_kernel(opts.audio.fft_size) ? "fixed-size" : "generic");
+    LOG_INFO("DSP latency: " + std::to_string(shifter.latency_samples()) + " samples");
 
-    bool muted = false;
+    if (opts.headless) {
+        std::unique_ptr<AudioMetrics> metrics;
+        if (!opts.metrics_target.empty()) metrics = std::make_unique<AudioMetrics>();
+        bool align = opts.backend == BackendType::FILE && !opts.playback_device.empty();
+        int rc = run_headless(audio, shifter, opts.audio.block_frames, opts.realtime, metrics.get(), align);
+        audio.close();
+        LOG_INFO("Goodbye!");
+        return rc;
+    }
 
-    while (running) {
-        std::fill(input_buffer.begin(), input_buffer.end(), 0.0f);
-        std::fill(output_buffer.begin(), output_buffer.end(), 0.0f);
+    AudioEngine engine(audio, shifter, opts.audio.block_frames);
+    engine.set_ui_fps(opts.ui_fps);
+    RealtimeReport realtime;
+    prepare_realtime(opts.realtime, shifter, realtime);
+    engine.set_realtime(opts.realtime, &realtime);
+    engine.start();
+    if (opts.realtime.enabled) {
+        LOG_INFO(Realtime::describe(realtime));
+    }
 
-        int captured = audio.capture(input_buffer.data(), BUFFER_FRAMES);
-        if (captured > 0) {
+    TUI ui;
+    ui.init();
+    ui.set_spectrum_range(engine.spectrum_bands().min_freq(), engine.spectrum_bands().max_freq());
+    ui.set_status(Realtime::summary(realtime));
+    TRACE_THREAD("ui");
 
-            shifter.process(input_buffer.data(), output_buffer.data(), captured);
+    // UI thread: drain stats from the audio thread and redraw at most
+    // opts.ui_fps times a second; the TUI itself only writes changed cells
+    AudioStats stats{};
+    stats.spectrum.resize(SPECTRUM_BARS, SPECTRUM_MIN_DB);
+    bool have_stats = false;
+    const auto frame_interval = std::chrono::microseconds(1000000 / opts.ui_fps);
+    auto next_frame = std::chrono::steady_clock::now();
 
-            if (muted) {
-                for (int i = 0; i < captured; i++) {
-                    output_buffer[i] = 0.0f;
-                }
-            }
+    while (running) {
+        while (AudioStats* latest = engine.stats_queue().front()) {
+            stats = *latest;
+            engine.stats_queue().pop();
+            have_stats = true;
+        }
 
-            audio.playback(output_buffer.data(), captured);
-
-            AudioStats stats;
-            float input_db = calculate_db(input_buffer.data(), captured);
-            float output_db = calculate_db(output_buffer.data(), captured);
-            stats.input_level = input_db;
-            stats.output_level = output_db;
-            stats.pitch_ratio = shifter.get_pitch_ratio();
-            stats.pitch_semitones = 0;
-            stats.spectrum.resize(spectrum_bins);
-            shifter.get_spectrum(stats.spectrum.data(), stats.spectrum.size());
-            stats.muted = muted;
-            stats.volume = shifter.get_volume();
+        if (have_stats) {
+            TRACE_SCOPE("ui_render");
             ui.render(stats);
         }
 
         int key = ui.get_key_input();
+        bool sent = true;
         if (key == 'q' || key == 'Q') {
             LOG_INFO("Quit key pressed");
             running = false;
         } else if (key == 'm' || key == 'M') {
-            muted = !muted;
-            LOG_INFO(std::string("Mute: ") + (muted ? "ON" : "OFF"));
+            bool muted = !engine.is_muted();
+            sent = engine.set_muted(muted);
+            if (sent) LOG_INFO(std::string("Mute: ") + (muted ? "ON" : "OFF"));
+        } else if (key == 'p' || key == 'P') {
+            ui.toggle_perf();
+        } else if (key == 'l' || key == 'L') {
+            engine.start_loopback_test();
+            LOG_INFO("Loopback latency test started");
+        } else if (key == 'e' || key == 'E') {
+            ShiftEngine next = engine.shift_engine() == ShiftEngine::STFT ? ShiftEngine::WSOLA : ShiftEngine::STFT;
+            engine.set_shift_engine(next);
+            LOG_INFO(std::string("Shift engine: ") + MultiChannelShifter::engine_name(next));
         } else if (key == ']') {
-            float v = shifter.get_volume();
-            shifter.set_volume(std::min(v + 0.05f, 1.0f));
+            sent = engine.set_volume(std::min(engine.get_volume() + 0.05f, 1.0f));
         } else if (key == '[') {
-            float v = shifter.get_volume();
-            shifter.set_volume(std::max(v - 0.05f, 0.0f));
+            sent = engine.set_volume(std::max(engine.get_volume() - 0.05f, 0.0f));
+        } else if (key == '+' || key == '-' || key == '=' || key == '_') {
+            float step = (key == '+' || key == '-') ? 0.1f : 0.01f;
+            float sign = (key == '+' || key == '=') ? 1.0f : -1.0f;
+            sent = engine.set_pitch_ratio(engine.get_pitch_ratio() + sign * step);
+        } else if (key == 'r' || key == 'R') {
+            sent = engine.set_pitch_ratio(1.0f);
+        }
+        if (!sent) {
+            // The audio thread is behind; the key can simply be pressed again
+            LOG_ERROR("Control queue full, key ignored");
         }
 
+        // A slow terminal only delays the next frame, never the audio thread
+        next_frame = std::max(next_frame + frame_interval, std::chrono::steady_clock::now());
+        std::this_thread::sleep_until(next_frame);
     }
 
+    engine.stop();
+    Tracer::instance().stop();
     ui.shutdown();
     audio.close();
+    AllocCheck::report();
 
     LOG_INFO("Goodbye!");
     return 0;
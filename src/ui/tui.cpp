@@ -3,6 +3,8 @@
 #include <ncurses.h>
 #include <algorithm>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
 
 namespace {
     const int METER_W = METER_WIDTH;
@@ -14,8 +16,6 @@ namespace {
     const float RED = METER_RED_DB;
     const int MASTER_H = MASTER_HEIGHT;
     const int SPECTRUM_B = SPECTRUM_BARS;
-    const float MIN_FREQ = SPECTRUM_MIN_FREQ;
-    const float MAX_FREQ = SPECTRUM_MAX_FREQ;
 
     int db_to_bar(float db) {
         int bar = static_cast<int>((db - METER_MIN) / (METER_MAX - METER_MIN) * METER_W);
@@ -28,71 +28,140 @@ namespace {
         return 1;
     }
 
-    void draw_bar(int row, int col, const char* label, int filled, float db) {
-        mvprintw(row, col, "%s", label);
-        for (int i = 0; i < METER_W; i++) {
-            if (i < filled) {
-                attron(COLOR_PAIR(get_color_for_db(db)));
-                addstr("#");
-                attroff(COLOR_PAIR(get_color_for_db(db)));
-            } else {
-                addstr("-");
-            }
+    // Updates a meter drawn as a run of cells starting at (row, col) and
+    // stepping by (drow, dcol). Only cells whose content changed since the
+    // last call are written; shown.filled < 0 forces a full redraw.
+    bool update_cells(int row, int col, int drow, int dcol, int length, TUI::Cells& shown,
+                      int filled, int color, chtype empty) {
+        if (filled == shown.filled && color == shown.color) return false;
+
+        int from = 0;
+        int to = length;
+        if (shown.filled >= 0 && color == shown.color) {
+            from = std::min(filled, shown.filled);
+            to = std::max(filled, shown.filled);
+        }
+        chtype full = '#' | COLOR_PAIR(color);
+        for (int i = from; i < to; i++) {
+            mvaddch(row + i * drow, col + i * dcol, i < filled ? full : empty);
         }
+        shown.filled = filled;
+        shown.color = color;
+        return true;
+    }
+
+    // " -12.3 dB" after a horizontal meter
+    bool update_db_text(int row, int col, float db, int& shown_tenths) {
+        int tenths = static_cast<int>(std::lround(db * 10.0f));
+        if (tenths == shown_tenths) return false;
         attron(COLOR_PAIR(4));
-        printw(" %5.1f dB", db);
+        mvprintw(row, col, " %5.1f dB", tenths / 10.0f);
         attroff(COLOR_PAIR(4));
+        shown_tenths = tenths;
+        return true;
     }
 
-    void draw_vertical_meter(int row, int col, int percent, float output_db, bool muted) {
-        int filled = (percent + 5) / 10;
-        int color = muted ? 3 : get_color_for_db(output_db);
+    void draw_master_scale(int row, int col) {
         for (int i = 0; i < MASTER_H; i++) {
             int level = MASTER_H - 1 - i;
-            int r = row + i;
-            int threshold = (level + 1) * 10;
-            mvprintw(r, col, "%3d%% ", threshold);
-            if (filled > level) {
-                attron(COLOR_PAIR(color));
-                addstr("#");
-                attroff(COLOR_PAIR(color));
-            } else {
-                addstr("-");
-            }
+            mvprintw(row + i, col, "%3d%% ", (level + 1) * 10);
         }
     }
 
-    void draw_spectrum(int row, int col, const float* spectrum, size_t num_bins) {
+    // Frequency labels under the bars they fall on, for the band range the
+    // engine reports; labels that would overlap the previous one are skipped
+    void draw_spectrum_axis(int row, int col, float min_hz, float max_hz) {
         mvprintw(row, col, "SPECTRUM:");
-        
-        for (int bar = 0; bar < SPECTRUM_B; bar++) {
-            float freq = MIN_FREQ * std::pow(MAX_FREQ / MIN_FREQ, 
-                static_cast<float>(bar) / SPECTRUM_B);
-            
-            int bin = static_cast<int>(freq / SAMPLE_RATE * FFT_SIZE);
-            
-            float db = (bin >= 0 && static_cast<size_t>(bin) < num_bins) ? spectrum[bin] : SPEC_MIN;
-            
-            int height = static_cast<int>((db - SPEC_MIN) / (SPEC_MAX - SPEC_MIN) * MASTER_H);
-            height = std::max(0, std::min(height, MASTER_H));
-            
-            int draw_col = col + 10 + bar * 2;
-            for (int h = 0; h < height; h++) {
-                int draw_row = row + MASTER_H - h;
-                attron(COLOR_PAIR(get_color_for_db(db)));
-                mvaddch(draw_row, draw_col, '#');
-                attroff(COLOR_PAIR(get_color_for_db(db)));
+        const float labels[] = {20.0f, 100.0f, 500.0f, 1000.0f, 5000.0f, 10000.0f, max_hz};
+        const float span = std::log(max_hz / min_hz);
+        int next_free = 0;
+        for (float hz : labels) {
+            if (hz < min_hz || hz > max_hz || span <= 0.0f) continue;
+            int bar = std::min(static_cast<int>(SPECTRUM_B * std::log(hz / min_hz) / span), SPECTRUM_B - 1);
+            int x = col + 10 + bar * 2;
+            if (x < next_free) continue;
+            char text[16];
+            if (hz >= 1000.0f) {
+                std::snprintf(text, sizeof(text), "%gkHz", std::round(hz / 100.0f) / 10.0f);
+            } else {
+                std::snprintf(text, sizeof(text), "%gHz", hz);
             }
+            mvprintw(row + MASTER_H + 1, x, "%s", text);
+            next_free = x + static_cast<int>(std::strlen(text)) + 2;
+        }
+    }
+
+    int spectrum_height(float db) {
+        int height = static_cast<int>((db - SPEC_MIN) / (SPEC_MAX - SPEC_MIN) * MASTER_H);
+        return std::max(0, std::min(height, MASTER_H));
+    }
+
+    // Same rounding as draw_perf, so the panel is redrawn only when it would change
+    void format_perf_key(const PerfStats& perf, char* key, size_t size) {
+        std::snprintf(key, size, "%.2f %.2f %.2f %.1f %.0f %llu %llu %.1f %.1f %d %d %.1f",
+                      perf.block_p50_ms, perf.block_p99_ms, perf.block_max_ms, perf.dsp_load,
+                      perf.dsp_load_peak, static_cast<unsigned long long>(perf.capture_xruns),
+                      static_cast<unsigned long long>(perf.playback_xruns), perf.pcm_delay_ms,
+                      perf.dsp_latency_ms, static_cast<int>(perf.engine), static_cast<int>(perf.loopback),
+                      perf.loopback_ms);
+    }
+
+    void draw_perf(int row, int col, const PerfStats& perf) {
+        for (int r = row; r < row + 3; r++) {
+            move(r, 0);
+            clrtoeol();
+        }
+
+        // Colour the load by headroom left in the block deadline
+        int load_color = perf.dsp_load_peak > 80.0f ? 3 : (perf.dsp_load_peak > 50.0f ? 2 : 1);
+        attron(COLOR_PAIR(5));
+        mvprintw(row, col, "PERF");
+        attroff(COLOR_PAIR(5));
+        printw("  block p50 %5.2f  p99 %5.2f  max %5.2f ms   load ",
+               perf.block_p50_ms, perf.block_p99_ms, perf.block_max_ms);
+        attron(COLOR_PAIR(load_color));
+        printw("%4.1f%% (peak %3.0f%%)", perf.dsp_load, perf.dsp_load_peak);
+        attroff(COLOR_PAIR(load_color));
+
+        int xrun_color = (perf.capture_xruns + perf.playback_xruns) > 0 ? 3 : 1;
+        mvprintw(row + 1, col + 6, "xruns ");
+        attron(COLOR_PAIR(xrun_color));
+        printw("in %llu out %llu", static_cast<unsigned long long>(perf.capture_xruns),
+               static_cast<unsigned long long>(perf.playback_xruns));
+        attroff(COLOR_PAIR(xrun_color));
+        if (perf.pcm_delay_ms >= 0.0f) {
+            printw("   PCM delay %5.1f ms", perf.pcm_delay_ms);
+        } else {
+            printw("   PCM delay   n/a");
+        }
+        printw("   DSP latency %5.1f ms (%s)", perf.dsp_latency_ms,
+               perf.engine == ShiftEngine::WSOLA ? "wsola" : "stft");
+
+        mvprintw(row + 2, col + 6, "loopback ");
+        switch (perf.loopback) {
+            case LoopbackState::IDLE:
+                printw("not measured (press l with the output audible to the input)");
+                break;
+            case LoopbackState::RUNNING:
+                printw("measuring...");
+                break;
+            case LoopbackState::DONE:
+                printw("%.1f ms round trip, %.1f ms with DSP", perf.loopback_ms,
+                       perf.loopback_ms + perf.dsp_latency_ms);
+                break;
+            case LoopbackState::FAILED:
+                attron(COLOR_PAIR(2));
+                printw("no impulse heard");
+                attroff(COLOR_PAIR(2));
+                break;
         }
-        
-        mvprintw(row + MASTER_H + 1, col + 10, "20Hz");
-        mvprintw(row + MASTER_H + 1, col + 30, "1kHz");
-        mvprintw(row + MASTER_H + 1, col + 50, "10kHz");
-        mvprintw(row + MASTER_H + 1, col + 68, "20kHz");
     }
 }
 
-TUI::TUI() : initialized_(false), width_(80), height_(24), smoothed_input_(-60.0f), smoothed_output_(-60.0f) {
+TUI::TUI() : initialized_(false), screen_(nullptr), width_(80), height_(24), smoothed_input_(-60.0f), smoothed_output_(-60.0f),
+    show_perf_(true), spectrum_min_hz_(SPECTRUM_MIN_FREQ), spectrum_max_hz_(SPECTRUM_MAX_FREQ),
+    chrome_drawn_(false), spectrum_shown_(SPECTRUM_BARS),
+    input_tenths_(INT32_MIN), output_tenths_(INT32_MIN), muted_shown_(-1), perf_key_{} {
 }
 
 TUI::~TUI() {
@@ -101,6 +170,17 @@ TUI::~TUI() {
 
 void TUI::init() {
     initscr();
+    setup_screen();
+}
+
+void TUI::init(const char* term, FILE* out, FILE* in) {
+    screen_ = newterm(term, out, in);
+    if (!screen_) return;
+    set_term(screen_);
+    setup_screen();
+}
+
+void TUI::setup_screen() {
     start_color();
     use_default_colors();
 
@@ -123,39 +203,103 @@ void TUI::shutdown() {
     if (initialized_) {
         endwin();
     }
+    if (screen_) {
+        delscreen(screen_);
+        screen_ = nullptr;
+    }
     initialized_ = false;
 }
 
-    void TUI::render(const AudioStats& stats) {
+void TUI::set_spectrum_range(float min_hz, float max_hz) {
+    spectrum_min_hz_ = min_hz;
+    spectrum_max_hz_ = max_hz;
+    chrome_drawn_ = false;
+}
+
+void TUI::set_status(const std::string& status) {
+    status_ = status;
+    chrome_drawn_ = false;
+}
+
+void TUI::toggle_perf() {
+    show_perf_ = !show_perf_;
+    chrome_drawn_ = false;
+}
+
+// Labels, scales and help never change; they are drawn once, and again only
+// after a resize or a layout change
+void TUI::draw_chrome() {
+    werase(stdscr);
+
+    mvprintw(1, 2, "IN:");
+    mvprintw(3, 2, "OUT:");
+    draw_master_scale(5, 2);
+    draw_spectrum_axis(5, 30, spectrum_min_hz_, spectrum_max_hz_);
+
+    attron(COLOR_PAIR(5));
+    mvprintw(21, 2, "%s", status_.c_str());
+    mvprintw(22, 2, "[p:perf panel] [l:loopback test] [e:stft/wsola]");
+    mvprintw(23, 2, "[q:quit] [m:mute] [ [/]:vol ]  [+/-:adj] [=/_:fine steps] [r:reset]");
+    attroff(COLOR_PAIR(5));
+
+    input_shown_ = Cells();
+    output_shown_ = Cells();
+    master_shown_ = Cells();
+    for (Cells& bar : spectrum_shown_) bar = Cells();
+    input_tenths_ = output_tenths_ = INT32_MIN;
+    muted_shown_ = -1;
+    perf_key_[0] = '\0';
+    chrome_drawn_ = true;
+}
+
+void TUI::render(const AudioStats& stats) {
     if (!initialized_) return;
 
     smoothed_input_ = smoothed_input_ * (1.0f - SMOOTHING_FACTOR) + stats.input_level * SMOOTHING_FACTOR;
     smoothed_output_ = smoothed_output_ * (1.0f - SMOOTHING_FACTOR) + stats.output_level * SMOOTHING_FACTOR;
 
-    werase(stdscr);
-
-    int in_bar = db_to_bar(smoothed_input_);
-    int out_bar = db_to_bar(smoothed_output_);
+    if (!chrome_drawn_) draw_chrome();
+    bool changed = false;
 
-    draw_bar(1, 2, "IN:", in_bar, smoothed_input_);
-    draw_bar(3, 2, "OUT:", out_bar, smoothed_output_);
+    changed |= update_cells(1, 5, 0, 1, METER_W, input_shown_, db_to_bar(smoothed_input_),
+                            get_color_for_db(smoothed_input_), '-');
+    changed |= update_db_text(1, 5 + METER_W, smoothed_input_, input_tenths_);
+    changed |= update_cells(3, 6, 0, 1, METER_W, output_shown_, db_to_bar(smoothed_output_),
+                            get_color_for_db(smoothed_output_), '-');
+    changed |= update_db_text(3, 6 + METER_W, smoothed_output_, output_tenths_);
 
+    // Master volume, bottom up
     int vol_percent = static_cast<int>(stats.volume * 100);
-    draw_vertical_meter(5, 2, vol_percent, stats.output_level, stats.muted);
-
-    attron(COLOR_PAIR(stats.muted ? 3 : 5));
-    mvprintw(16, 2, stats.muted ? "MUTE" : "MASTER");
-    attroff(COLOR_PAIR(stats.muted ? 3 : 5));
+    int master_color = stats.muted ? 3 : get_color_for_db(stats.output_level);
+    changed |= update_cells(5 + MASTER_H - 1, 7, -1, 0, MASTER_H, master_shown_, (vol_percent + 5) / 10,
+                            master_color, '-');
+    if (static_cast<int>(stats.muted) != muted_shown_) {
+        attron(COLOR_PAIR(stats.muted ? 3 : 5));
+        mvprintw(16, 2, stats.muted ? "MUTE  " : "MASTER");
+        attroff(COLOR_PAIR(stats.muted ? 3 : 5));
+        muted_shown_ = stats.muted;
+        changed = true;
+    }
 
-    if (!stats.spectrum.empty()) {
-        draw_spectrum(5, 30, stats.spectrum.data(), stats.spectrum.size());
+    for (int bar = 0; bar < SPECTRUM_B; bar++) {
+        float db = static_cast<size_t>(bar) < stats.spectrum.size() ? stats.spectrum[bar] : SPEC_MIN;
+        changed |= update_cells(5 + MASTER_H, 40 + bar * 2, -1, 0, MASTER_H, spectrum_shown_[bar],
+                                spectrum_height(db), get_color_for_db(db), ' ');
     }
 
-    attron(COLOR_PAIR(5));
-    mvprintw(23, 2, "[q:quit] [m:mute] [ [/]:vol ]  [+/-:adj] [=/_:fine steps] [r:reset]");
-    attroff(COLOR_PAIR(5));
+    if (show_perf_) {
+        char key[sizeof(perf_key_)];
+        format_perf_key(stats.perf, key, sizeof(key));
+        if (std::strcmp(key, perf_key_) != 0) {
+            draw_perf(18, 2, stats.perf);
+            std::memcpy(perf_key_, key, sizeof(perf_key_));
+            changed = true;
+        }
+    }
 
-    refresh();
+    if (changed) {
+        refresh();
+    }
 }
 
 int TUI::get_key_input() {
@@ -165,5 +309,9 @@ int TUI::get_key_input() {
     if (ch == ERR) {
         return 0;
     }
+    if (ch == KEY_RESIZE) {
+        chrome_drawn_ = false;
+        return 0;
+    }
     return ch;
 }
@@ -1,17 +1,12 @@
 #pragma once
 
+#include <cstdint>
+#include <cstdio>
 #include <string>
 #include <vector>
+#include "audio/stats.h"
 
-struct AudioStats {
-    float input_level;
-    float output_level;
-    float pitch_ratio;
-    int pitch_semitones;
-    std::vector<float> spectrum;
-    bool muted;
-    float volume;
-};
+struct screen;
 
 class TUI {
 public:
@@ -19,14 +14,49 @@ public:
     ~TUI();
 
     void init();
+    // Render to the given streams instead of the controlling terminal
+    // (e.g. /dev/null for benchmarks)
+    void init(const char* term, FILE* out, FILE* in);
     void shutdown();
     void render(const AudioStats& stats);
     int get_key_input();
+    void toggle_perf();
+
+    // Band edges of AudioStats::spectrum, for the axis labels
+    void set_spectrum_range(float min_hz, float max_hz);
+
+    // A fixed line above the help (e.g. the real-time mode summary)
+    void set_status(const std::string& status);
+
+    // What a meter currently shows on screen; filled < 0 means unknown
+    struct Cells {
+        int filled = -1;
+        int color = -1;
+    };
 
 private:
+    void setup_screen();
+    void draw_chrome();
+
     bool initialized_;
+    screen* screen_;
     int width_;
     int height_;
     float smoothed_input_;
     float smoothed_output_;
+    bool show_perf_;
+    float spectrum_min_hz_;
+    float spectrum_max_hz_;
+    std::string status_;
+
+    // Last frame on screen: render() only writes cells that changed
+    bool chrome_drawn_;
+    Cells input_shown_;
+    Cells output_shown_;
+    Cells master_shown_;
+    std::vector<Cells> spectrum_shown_;
+    int input_tenths_;   // dB text, in 0.1 dB
+    int output_tenths_;
+    int muted_shown_;
+    char perf_key_[160];
 };
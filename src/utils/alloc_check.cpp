@@ -0,0 +1,128 @@
+#include "utils/alloc_check.h"
+#include "config.h"
+
+#ifdef VOCODER_ALLOC_CHECK
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <execinfo.h>
+
+extern "C" {
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* ptr, size_t size);
+    void* __libc_memalign(size_t alignment, size_t size);
+    void __libc_free(void* ptr);
+}
+
+namespace {
+    // Plain globals and static TLS: nothing here may allocate
+    thread_local bool watched = false;
+    thread_local bool inside = false;
+    std::atomic<bool> armed{false};
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> allocated_bytes{0};
+    std::atomic<bool> have_stack{false};
+    void* first_stack[ALLOC_CHECK_STACK_DEPTH];
+    int first_depth = 0;
+
+    inline void note(size_t size) {
+        if (!watched || inside || !armed.load(std::memory_order_relaxed)) return;
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+        if (!have_stack.exchange(true, std::memory_order_relaxed)) {
+            inside = true;
+            first_depth = backtrace(first_stack, ALLOC_CHECK_STACK_DEPTH);
+            inside = false;
+        }
+    }
+}
+
+extern "C" {
+    void* malloc(size_t size) {
+        note(size);
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size) {
+        note(count * size);
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* ptr, size_t size) {
+        note(size);
+        return __libc_realloc(ptr, size);
+    }
+
+    void free(void* ptr) {
+        __libc_free(ptr);
+    }
+
+    void* memalign(size_t alignment, size_t size) {
+        note(size);
+        return __libc_memalign(alignment, size);
+    }
+
+    void* aligned_alloc(size_t alignment, size_t size) {
+        note(size);
+        return __libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void** ptr, size_t alignment, size_t size) {
+        note(size);
+        *ptr = __libc_memalign(alignment, size);
+        return *ptr ? 0 : ENOMEM;
+    }
+}
+
+void AllocCheck::watch_thread() {
+    watched = true;
+}
+
+void AllocCheck::unwatch_thread() {
+    watched = false;
+}
+
+void AllocCheck::arm() {
+    // backtrace() loads its unwinder on first use, which allocates
+    void* probe[1];
+    inside = true;
+    backtrace(probe, 1);
+    inside = false;
+    armed.store(true, std::memory_order_relaxed);
+}
+
+uint64_t AllocCheck::count() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+uint64_t AllocCheck::bytes() {
+    return allocated_bytes.load(std::memory_order_relaxed);
+}
+
+void AllocCheck::report() {
+    uint64_t n = count();
+    if (!armed.load(std::memory_order_relaxed)) {
+        std::fprintf(stderr, "Allocation check: never armed (run shorter than the warm-up)\n");
+        return;
+    }
+    std::fprintf(stderr, "Allocation check: %llu allocations (%llu bytes) on the audio path after warm-up\n",
+                 static_cast<unsigned long long>(n), static_cast<unsigned long long>(bytes()));
+    if (n > 0 && have_stack.load(std::memory_order_relaxed)) {
+        std::fprintf(stderr, "First allocation:\n");
+        backtrace_symbols_fd(first_stack, first_depth, 2);
+    }
+}
+
+#else
+
+void AllocCheck::watch_thread() {}
+void AllocCheck::unwatch_thread() {}
+void AllocCheck::arm() {}
+uint64_t AllocCheck::count() { return 0; }
+uint64_t AllocCheck::bytes() { return 0; }
+void AllocCheck::report() {}
+
+#endif
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+
+// Heap allocation checking for the real-time path.
+// Built with -DVOCODER_ALLOC_CHECK=ON, malloc, calloc, realloc and the
+// aligned variants are interposed (operator new goes through malloc), and
+// every allocation made by a watched thread after arm() is counted. The
+// first one's call stack is kept for report(). Without the option all of
+// this compiles to no-ops.
+//
+// The audio path is expected to stay at zero: buffers, stats and log
+// records are preallocated, and the real-time code logs through the
+// printf-style LOG_*F macros only.
+class AllocCheck {
+public:
+    static constexpr bool compiled_in() {
+#ifdef VOCODER_ALLOC_CHECK
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Count allocations made by the calling thread once armed, until
+    // unwatch_thread() (call it before the thread's shutdown code)
+    static void watch_thread();
+    static void unwatch_thread();
+
+    // Start counting, after warm-up
+    static void arm();
+
+    static uint64_t count();
+    static uint64_t bytes();
+
+    // Prints the totals and the first offending call stack to stderr
+    static void report();
+};
@@ -0,0 +1,18 @@
+#include "utils/fs.h"
+#include <cerrno>
+#include <sys/stat.h>
+
+bool make_dirs(const std::string& dir) {
+    for (size_t pos = 1; pos != std::string::npos; ) {
+        pos = dir.find('/', pos + 1);
+        mkdir(dir.substr(0, pos).c_str(), 0755);
+    }
+
+    struct stat st;
+    if (stat(dir.c_str(), &st) < 0) return false;
+    if (!S_ISDIR(st.st_mode)) {
+        errno = ENOTDIR;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <string>
+
+// Creates dir and any missing parents (mode 0755). Returns false, with errno
+// set, if dir does not exist as a directory afterwards.
+bool make_dirs(const std::string& dir);
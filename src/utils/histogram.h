@@ -0,0 +1,68 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+// Fixed-size log-scale histogram for timings (in microseconds).
+// Each octave from 1 us up to ~2 s is split into SUB_BUCKETS buckets, so a
+// percentile is exact to within ~9%. Recording never allocates, which makes
+// it usable on the audio thread.
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKETS = 8;
+    static constexpr int OCTAVES = 21;
+    static constexpr int BUCKETS = SUB_BUCKETS * OCTAVES;
+
+    LatencyHistogram() { reset(); }
+
+    void reset() {
+        counts_.fill(0);
+        count_ = 0;
+        max_ = 0.0f;
+    }
+
+    void record(float us) {
+        counts_[bucket(us)]++;
+        count_++;
+        max_ = std::max(max_, us);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (int i = 0; i < BUCKETS; i++) counts_[i] += other.counts_[i];
+        count_ += other.count_;
+        max_ = std::max(max_, other.max_);
+    }
+
+    // Upper edge of the bucket holding the p-th percentile (p in [0, 100])
+    float percentile(float p) const {
+        if (count_ == 0) return 0.0f;
+        uint64_t rank = static_cast<uint64_t>(std::ceil(p / 100.0f * count_));
+        rank = std::max<uint64_t>(rank, 1);
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; i++) {
+            seen += counts_[i];
+            if (seen >= rank) return std::min(upper_edge(i), max_);
+        }
+        return max_;
+    }
+
+    float max() const { return max_; }
+    uint64_t count() const { return count_; }
+
+private:
+    static int bucket(float us) {
+        if (us <= 1.0f) return 0;
+        int index = static_cast<int>(std::log2(us) * SUB_BUCKETS);
+        return std::min(index, BUCKETS - 1);
+    }
+
+    static float upper_edge(int index) {
+        return std::exp2(static_cast<float>(index + 1) / SUB_BUCKETS);
+    }
+
+    std::array<uint32_t, BUCKETS> counts_;
+    uint64_t count_;
+    float max_;
+};
@@ -1,14 +1,28 @@
 #include "utils/logger.h"
-#include <iostream>
-#include <sstream>
-#include <iomanip>
-
-Logger::Logger() : min_level_(LogLevel::DEBUG) {
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstring>
+
+Logger::Logger()
+    : min_level_(LogLevel::DEBUG), queue_(LOG_QUEUE_SIZE), dropped_(0), reported_dropped_(0),
+      file_(nullptr), stopping_(false) {
+    writer_ = std::thread(&Logger::writer_loop, this);
 }
 
 Logger::~Logger() {
-    if (file_.is_open()) {
-        file_.close();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    writer_.join();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    drain();
+    if (file_) {
+        std::fclose(file_);
+        file_ = nullptr;
     }
 }
 
@@ -18,15 +32,16 @@ Logger& Logger::instance() {
 }
 
 void Logger::set_level(LogLevel level) {
-    min_level_ = level;
+    min_level_.store(level, std::memory_order_relaxed);
 }
 
 void Logger::set_file(const std::string& filepath) {
     std::lock_guard<std::mutex> lock(mutex_);
-    if (file_.is_open()) {
-        file_.close();
+    drain();
+    if (file_) {
+        std::fclose(file_);
     }
-    file_.open(filepath, std::ios::app);
+    file_ = std::fopen(filepath.c_str(), "a");
 }
 
 void Logger::debug(const std::string& msg) {
@@ -41,31 +56,93 @@ void Logger::error(const std::string& msg) {
     log(LogLevel::ERROR, msg);
 }
 
-void Logger::log(LogLevel level, const std::string& msg) {
-    if (level < min_level_) {
-        return;
+Logger::Record* Logger::begin_record(LogLevel level, size_t& ticket) {
+    if (level < min_level_.load(std::memory_order_relaxed)) {
+        return nullptr;
     }
 
+    Record* record = queue_.begin_write(ticket);
+    if (!record) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    record->level = level;
+    clock_gettime(CLOCK_REALTIME, &record->time);
+    return record;
+}
+
+void Logger::log(LogLevel level, const std::string& msg) {
+    size_t ticket;
+    Record* record = begin_record(level, ticket);
+    if (!record) return;
+
+    size_t length = std::min(msg.size(), sizeof(record->text) - 1);
+    std::memcpy(record->text, msg.data(), length);
+    record->text[length] = '\0';
+    queue_.commit_write(ticket);
+}
+
+void Logger::logf(LogLevel level, const char* format, ...) {
+    size_t ticket;
+    Record* record = begin_record(level, ticket);
+    if (!record) return;
+
+    va_list args;
+    va_start(args, format);
+    std::vsnprintf(record->text, sizeof(record->text), format, args);
+    va_end(args);
+    queue_.commit_write(ticket);
+}
+
+void Logger::flush() {
     std::lock_guard<std::mutex> lock(mutex_);
+    drain();
+}
 
-    std::ostringstream oss;
-    oss << "[" << get_timestamp() << "] [" << level_to_string(level) << "] " << msg;
+void Logger::writer_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        drain();
+        // Producers never signal (that would mean taking the mutex), so the
+        // writer polls
+        wake_.wait_for(lock, std::chrono::milliseconds(LOG_FLUSH_MS));
+    }
+}
 
-    std::string line = oss.str();
+void Logger::drain() {
+    bool wrote = false;
+    while (Record* record = queue_.front()) {
+        write_line(record->time, record->level, record->text);
+        queue_.pop();
+        wrote = true;
+    }
+
+    uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+    if (dropped != reported_dropped_) {
+        char text[64];
+        std::snprintf(text, sizeof(text), "%llu log messages dropped (queue full)",
+                      static_cast<unsigned long long>(dropped - reported_dropped_));
+        timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        write_line(now, LogLevel::ERROR, text);
+        reported_dropped_ = dropped;
+        wrote = true;
+    }
 
-    if (file_.is_open()) {
-        file_ << line << std::endl;
-        file_.flush();
+    if (wrote && file_) {
+        std::fflush(file_);
     }
 }
 
-std::string Logger::get_timestamp() {
-    time_t now = time(nullptr);
-    tm* local = localtime(&now);
+void Logger::write_line(const timespec& time, LogLevel level, const char* text) {
+    if (!file_) return;
 
-    std::ostringstream oss;
-    oss << std::put_time(local, "%Y-%m-%d %H:%M:%S");
-    return oss.str();
+    tm local;
+    localtime_r(&time.tv_sec, &local);
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &local);
+    std::fprintf(file_, "[%s.%03ld] [%s] %s\n", stamp, time.tv_nsec / 1000000,
+                 level_to_string(level).c_str(), text);
 }
 
 std::string Logger::level_to_string(LogLevel level) {
@@ -1,9 +1,15 @@
 #pragma once
 
-#include <string>
-#include <fstream>
-#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
 #include <ctime>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "utils/mpsc_queue.h"
+#include "config.h"
 
 enum class LogLevel {
     DEBUG,
@@ -11,6 +17,13 @@ enum class LogLevel {
     ERROR
 };
 
+// Asynchronous logger.
+// Callers format into a preallocated record in a lock-free ring buffer and
+// return; a background thread timestamps, writes and flushes the records in
+// batches. Logging never blocks or allocates (the printf-style calls don't
+// allocate; the std::string ones only as much as building the argument did),
+// so it is safe from the audio thread. When the ring is full, records are
+// dropped and counted, and the writer reports the count in the log.
 class Logger {
 public:
     static Logger& instance();
@@ -23,22 +36,52 @@ public:
     void error(const std::string& msg);
 
     void log(LogLevel level, const std::string& msg);
+    void logf(LogLevel level, const char* format, ...) __attribute__((format(printf, 3, 4)));
+
+    // Writes out everything logged so far
+    void flush();
+
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
 
 private:
+    struct Record {
+        LogLevel level;
+        timespec time;
+        char text[LOG_MESSAGE_SIZE];
+    };
+
     Logger();
     ~Logger();
 
     Logger(const Logger&) = delete;
     Logger& operator=(const Logger&) = delete;
 
-    std::string get_timestamp();
+    Record* begin_record(LogLevel level, size_t& ticket);
+    void writer_loop();
+    void drain();  // with mutex_ held
+    void write_line(const timespec& time, LogLevel level, const char* text);
+
     std::string level_to_string(LogLevel level);
 
-    LogLevel min_level_;
-    std::ofstream file_;
+    std::atomic<LogLevel> min_level_;
+    MPSCQueue<Record> queue_;
+    std::atomic<uint64_t> dropped_;
+    uint64_t reported_dropped_;
+
+    // Writer side
+    FILE* file_;
     std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_;
+    std::thread writer_;
 };
 
 #define LOG_DEBUG(msg) Logger::instance().debug(msg)
 #define LOG_INFO(msg) Logger::instance().info(msg)
 #define LOG_ERROR(msg) Logger::instance().error(msg)
+
+// printf-style variants that format straight into the ring buffer, for the
+// real-time path
+#define LOG_DEBUGF(...) Logger::instance().logf(LogLevel::DEBUG, __VA_ARGS__)
+#define LOG_INFOF(...) Logger::instance().logf(LogLevel::INFO, __VA_ARGS__)
+#define LOG_ERRORF(...) Logger::instance().logf(LogLevel::ERROR, __VA_ARGS__)
@@ -0,0 +1,239 @@
+#include "utils/metrics.h"
+#include "utils/logger.h"
+#include "config.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+    // Indexed by MetricsRegistry::Type
+    const char* const TYPE_NAMES[] = {"counter", "gauge", "histogram"};
+
+    std::string format_value(double value) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.9g", value);
+        return text;
+    }
+
+    std::string with_labels(const std::string& name, const std::string& labels, const std::string& extra = "") {
+        std::string all = labels;
+        if (!extra.empty()) all += (all.empty() ? "" : ",") + extra;
+        return all.empty() ? name : name + "{" + all + "}";
+    }
+
+    // Exporting must never compete with the audio thread
+    void lower_thread_priority() {
+        setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+    }
+}
+
+Histogram::Histogram(const std::vector<double>& bounds)
+    : bounds_(bounds), counts_(new std::atomic<uint64_t>[bounds.size() + 1]) {
+    std::sort(bounds_.begin(), bounds_.end());
+    for (size_t i = 0; i <= bounds_.size(); i++) {
+        counts_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void Histogram::observe(double value) {
+    size_t i = 0;
+    while (i < bounds_.size() && value > bounds_[i]) i++;
+    counts_[i].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.store(sum_.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+MetricsRegistry& MetricsRegistry::instance() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+// A name is one metric family with one type. Registering it again with
+// another type is a programming error, so it stops the program here rather
+// than handing out a reference to nothing.
+MetricsRegistry::Entry* MetricsRegistry::find(const std::string& name, const std::string& labels, Type type) {
+    Entry* found = nullptr;
+    for (Entry& entry : entries_) {
+        if (entry.name != name) continue;
+        if (entry.type != type) {
+            std::fprintf(stderr, "Metric %s registered as a %s and as a %s\n", name.c_str(),
+                         TYPE_NAMES[static_cast<int>(entry.type)], TYPE_NAMES[static_cast<int>(type)]);
+            std::abort();
+        }
+        if (entry.labels == labels) found = &entry;
+    }
+    return found;
+}
+
+Counter& MetricsRegistry::counter(const std::string& name, const std::string& help, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (Entry* entry = find(name, labels, Type::COUNTER)) return *entry->counter;
+    entries_.push_back(Entry{name, help, labels, Type::COUNTER, std::make_unique<Counter>(), nullptr, nullptr});
+    return *entries_.back().counter;
+}
+
+Gauge& MetricsRegistry::gauge(const std::string& name, const std::string& help, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (Entry* entry = find(name, labels, Type::GAUGE)) return *entry->gauge;
+    entries_.push_back(Entry{name, help, labels, Type::GAUGE, nullptr, std::make_unique<Gauge>(), nullptr});
+    return *entries_.back().gauge;
+}
+
+Histogram& MetricsRegistry::histogram(const std::string& name, const std::string& help,
+                                      const std::vector<double>& bounds) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (Entry* entry = find(name, "", Type::HISTOGRAM)) return *entry->histogram;
+    entries_.push_back(Entry{name, help, "", Type::HISTOGRAM, nullptr, nullptr, std::make_unique<Histogram>(bounds)});
+    return *entries_.back().histogram;
+}
+
+std::string MetricsRegistry::render() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string out;
+    std::set<std::string> done;
+
+    for (const Entry& family : entries_) {
+        if (!done.insert(family.name).second) continue;
+
+        out += "# HELP " + family.name + " " + family.help + "\n";
+        out += "# TYPE " + family.name + " " + TYPE_NAMES[static_cast<int>(family.type)] + "\n";
+
+        for (const Entry& entry : entries_) {
+            if (entry.name != family.name) continue;
+
+            switch (entry.type) {
+                case Type::COUNTER:
+                    out += with_labels(entry.name, entry.labels) + " " + std::to_string(entry.counter->value()) + "\n";
+                    break;
+                case Type::GAUGE:
+                    out += with_labels(entry.name, entry.labels) + " " + format_value(entry.gauge->value()) + "\n";
+                    break;
+                case Type::HISTOGRAM: {
+                    const Histogram& h = *entry.histogram;
+                    uint64_t cumulative = 0;
+                    for (size_t i = 0; i <= h.bounds().size(); i++) {
+                        cumulative += h.bucket_count(i);
+                        std::string le = i < h.bounds().size() ? format_value(h.bounds()[i]) : "+Inf";
+                        out += with_labels(entry.name + "_bucket", entry.labels, "le=\"" + le + "\"") + " " +
+                               std::to_string(cumulative) + "\n";
+                    }
+                    out += with_labels(entry.name + "_sum", entry.labels) + " " + format_value(h.sum()) + "\n";
+                    out += with_labels(entry.name + "_count", entry.labels) + " " + std::to_string(h.count()) + "\n";
+                    break;
+                }
+            }
+        }
+    }
+    return out;
+}
+
+MetricsExporter::MetricsExporter() : socket_mode_(false), listen_fd_(-1), running_(false) {
+}
+
+MetricsExporter::~MetricsExporter() {
+    stop();
+}
+
+bool MetricsExporter::start(const std::string& target) {
+    socket_mode_ = target.compare(0, 5, "unix:") == 0;
+    path_ = socket_mode_ ? target.substr(5) : target;
+
+    if (socket_mode_) {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (path_.size() >= sizeof(addr.sun_path)) {
+            LOG_ERROR("Metrics socket path too long: " + path_);
+            return false;
+        }
+        std::strcpy(addr.sun_path, path_.c_str());
+
+        listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        unlink(path_.c_str());
+        if (listen_fd_ < 0 || bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+            listen(listen_fd_, 4) < 0) {
+            LOG_ERROR("Cannot listen on metrics socket " + path_ + ": " + std::strerror(errno));
+            if (listen_fd_ >= 0) ::close(listen_fd_);
+            listen_fd_ = -1;
+            return false;
+        }
+    }
+
+    running_ = true;
+    thread_ = std::thread(socket_mode_ ? &MetricsExporter::serve_socket : &MetricsExporter::write_file, this);
+    LOG_INFO(std::string("Metrics: ") + (socket_mode_ ? "serving on unix socket " : "writing to ") + path_);
+    return true;
+}
+
+void MetricsExporter::stop() {
+    running_ = false;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    if (listen_fd_ >= 0) {
+        ::close(listen_fd_);
+        listen_fd_ = -1;
+        unlink(path_.c_str());
+    }
+}
+
+void MetricsExporter::serve_socket() {
+    lower_thread_priority();
+    while (running_) {
+        pollfd pfd{listen_fd_, POLLIN, 0};
+        if (poll(&pfd, 1, METRICS_FILE_INTERVAL_MS) <= 0) continue;
+
+        int client = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) continue;
+
+        // Swallow the request line, if any, without waiting long for it
+        char request[1024];
+        pollfd cpfd{client, POLLIN, 0};
+        if (poll(&cpfd, 1, 100) > 0) {
+            ssize_t ignored = recv(client, request, sizeof(request), MSG_DONTWAIT);
+            (void)ignored;
+        }
+
+        std::string body = MetricsRegistry::instance().render();
+        std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                               "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+        for (size_t sent = 0; sent < response.size(); ) {
+            ssize_t n = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) break;
+            sent += static_cast<size_t>(n);
+        }
+        ::close(client);
+    }
+}
+
+void MetricsExporter::write_file() {
+    lower_thread_priority();
+    for (;;) {
+        std::string body = MetricsRegistry::instance().render();
+        std::string tmp = path_ + ".tmp";
+        FILE* file = std::fopen(tmp.c_str(), "w");
+        bool ok = file != nullptr;
+        if (file) {
+            ok = std::fwrite(body.data(), 1, body.size(), file) == body.size();
+            ok = (std::fclose(file) == 0) && ok;
+        }
+        if (!ok || std::rename(tmp.c_str(), path_.c_str()) != 0) {
+            LOG_ERROR("Cannot write metrics file " + path_);
+        }
+
+        // One last snapshot after stop(), so short runs leave final values
+        if (!running_) break;
+        for (int waited = 0; running_ && waited < METRICS_FILE_INTERVAL_MS; waited += 50) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+    }
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Lock-free metrics for the audio path, exported in Prometheus text format.
+// Metrics are registered once at startup (this allocates and locks); after
+// that, updating one is a relaxed atomic operation and never blocks, so the
+// audio thread can update them freely. Registering a name twice returns the
+// same metric.
+
+class Counter {
+public:
+    void add(uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value_{0};
+};
+
+class Gauge {
+public:
+    void set(double value) { value_.store(value, std::memory_order_relaxed); }
+    double value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<double> value_{0.0};
+};
+
+// Fixed upper bucket bounds, Prometheus style (cumulative on export).
+// observe() is lock-free; the sum assumes a single writer per histogram.
+class Histogram {
+public:
+    explicit Histogram(const std::vector<double>& bounds);
+
+    void observe(double value);
+
+    const std::vector<double>& bounds() const { return bounds_; }
+    uint64_t bucket_count(size_t i) const { return counts_[i].load(std::memory_order_relaxed); }
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    double sum() const { return sum_.load(std::memory_order_relaxed); }
+
+private:
+    std::vector<double> bounds_;
+    std::unique_ptr<std::atomic<uint64_t>[]> counts_;  // bounds_.size() + 1 (+Inf)
+    std::atomic<uint64_t> count_{0};
+    std::atomic<double> sum_{0.0};
+};
+
+class MetricsRegistry {
+public:
+    static MetricsRegistry& instance();
+
+    // labels are in Prometheus syntax without braces, e.g. stream="capture".
+    // Registering an existing name returns the same metric; registering it
+    // with a different type aborts.
+    Counter& counter(const std::string& name, const std::string& help, const std::string& labels = "");
+    Gauge& gauge(const std::string& name, const std::string& help, const std::string& labels = "");
+    Histogram& histogram(const std::string& name, const std::string& help, const std::vector<double>& bounds);
+
+    // Prometheus text exposition format
+    std::string render();
+
+private:
+    enum class Type { COUNTER, GAUGE, HISTOGRAM };
+
+    struct Entry {
+        std::string name;
+        std::string help;
+        std::string labels;
+        Type type;
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Gauge> gauge;
+        std::unique_ptr<Histogram> histogram;
+    };
+
+    MetricsRegistry() = default;
+    Entry* find(const std::string& name, const std::string& labels, Type type);
+
+    std::mutex mutex_;
+    std::deque<Entry> entries_;  // registration order, grouped by name on export
+};
+
+// Publishes the registry from a low-priority thread, either to a Unix domain
+// socket (target "unix:/path"; every connection gets one scrape as an
+// HTTP/1.0 response) or to a file rewritten atomically every
+// METRICS_FILE_INTERVAL_MS (node_exporter textfile style).
+class MetricsExporter {
+public:
+    MetricsExporter();
+    ~MetricsExporter();
+
+    bool start(const std::string& target);
+    void stop();
+
+private:
+    void serve_socket();
+    void write_file();
+
+    std::string path_;
+    bool socket_mode_;
+    int listen_fd_;
+    std::atomic<bool> running_;
+    std::thread thread_;
+};
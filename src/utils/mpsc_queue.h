@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded lock-free multi-producer/single-consumer queue.
+// Same in-place slot API as SPSCQueue, but any number of threads may write:
+// each slot carries a sequence number that tells producers when it is free
+// and the consumer when it has been published. Writers never block; a full
+// queue simply refuses the write.
+template <typename T>
+class MPSCQueue {
+public:
+    explicit MPSCQueue(size_t capacity, const T& prototype = T())
+        : mask_(round_up_pow2(capacity) - 1), cells_(mask_ + 1), head_(0), tail_(0) {
+        for (size_t i = 0; i <= mask_; i++) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+            cells_[i].value = prototype;
+        }
+    }
+
+    MPSCQueue(const MPSCQueue&) = delete;
+    MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+    // Producer: claims a slot to fill in place, or nullptr when full.
+    // The ticket is handed back to commit_write().
+    T* begin_write(size_t& ticket) {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells_[pos & mask_];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if (sequence == pos) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    ticket = pos;
+                    return &cell.value;
+                }
+            } else if (sequence < pos) {
+                return nullptr;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void commit_write(size_t ticket) {
+        cells_[ticket & mask_].sequence.store(ticket + 1, std::memory_order_release);
+    }
+
+    // Consumer: oldest published element, or nullptr when empty
+    T* front() {
+        Cell& cell = cells_[head_ & mask_];
+        if (cell.sequence.load(std::memory_order_acquire) != head_ + 1) {
+            return nullptr;
+        }
+        return &cell.value;
+    }
+
+    void pop() {
+        cells_[head_ & mask_].sequence.store(head_ + mask_ + 1, std::memory_order_release);
+        head_++;
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    static size_t round_up_pow2(size_t n) {
+        size_t p = 1;
+        while (p < n) p <<= 1;
+        return p;
+    }
+
+    const size_t mask_;
+    std::vector<Cell> cells_;
+    size_t head_;  // consumer only
+    alignas(64) std::atomic<size_t> tail_;
+};
@@ -0,0 +1,382 @@
+#include "utils/options.h"
+#include "dsp/multichannel.h"
+#include "config.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <getopt.h>
+
+void print_usage(const char* prog) {
+    std::fprintf(stderr,
+        "Usage: %s [options] [batch inputs...]\n"
+        "  -b, --backend <alsa|file|null>  audio backend (default: alsa)\n"
+        "  -i, --input <name>              capture device or input WAV file\n"
+        "  -o, --output <name>             playback device or output WAV file\n"
+        "  -H, --headless                  run without the TUI and report throughput\n"
+        "                                  (implied by the file and null backends)\n"
+        "  -c, --channels <n>              channel count (file backend: taken from the input)\n"
+        "  -P, --period <frames>           ALSA period size (default: calibrated, else driver)\n"
+        "  -n, --periods <n>               ALSA periods per buffer (default: driver)\n"
+        "  -C, --calibrate                 find the smallest stable ALSA period and cache it\n"
+        "  -W, --no-drift                  no clock-drift resampling between capture and\n"
+        "                                  playback devices that cannot be linked\n"
+        "  -L, --phase-lock                lock channel phases to keep the stereo image\n"
+        "  -D, --pipeline                  run STFT analysis and synthesis on separate cores\n"
+        "                                  (one hop more latency; not with -L)\n"
+        "  -p, --pitch <ratio>             pitch ratio (default: 1.0)\n"
+        "  -r, --rate <hz>                 sample rate (default: %d; WAV input: the file's)\n"
+        "  -N, --fft-size <n>              phase vocoder FFT size (default: %d)\n"
+        "  -k, --hop-size <n>              phase vocoder hop (default: %d)\n"
+        "  -K, --block <frames>            frames per processing block (default: %d)\n"
+        "  -S, --sample-format <format>    ALSA sample format: auto|float|s32|s24|s16\n"
+        "                                  (default: auto, the device's best)\n"
+        "  -E, --engine <stft|wsola>       shifter: phase vocoder, or low-latency WSOLA\n"
+        "                                  (default: stft; 'e' toggles it in the TUI)\n"
+        "  -s, --seconds <n>               length of the null backend tone (default: 10)\n"
+        "  -e, --fft-effort <level>        FFTW planning: estimate|measure|patient|exhaustive\n"
+        "                                  (default: measure, cached as wisdom)\n"
+        "  -w, --wisdom-dir <dir>          FFTW wisdom cache (default: ~/.cache/vocoder-tui)\n"
+        "  -B, --batch <path>              batch mode: a WAV file, a directory of WAV files\n"
+        "                                  or a list file (repeatable; extra arguments too)\n"
+        "  -O, --output-dir <dir>          batch output directory (default: no output)\n"
+        "  -j, --jobs <n>                  batch worker threads (default: one per core)\n"
+        "  -M, --metrics <target>          export Prometheus metrics: unix:<socket path>, or a\n"
+        "                                  file rewritten every second\n"
+        "  -T, --trace <dir>               dump the last seconds of stage timings as Chrome\n"
+        "                                  trace JSON on SIGUSR1 or xrun (-DVOCODER_TRACE=ON)\n"
+        "  -F, --fps <n>                   TUI redraws per second (default: %d)\n"
+        "  -R, --realtime                  SCHED_FIFO audio thread, locked and prefaulted\n"
+        "                                  memory, denormals flushed to zero\n"
+        "  -Q, --rt-priority <n>           SCHED_FIFO priority, 1-99 (default: %d; implies -R)\n"
+        "  -A, --cpu <n>                   pin the audio thread to core n (implies -R)\n"
+        "  -f, --config <file>             read options from a file of 'name = value' lines\n"
+        "                                  (long option names); the command line overrides it\n"
+        "  -h, --help                      show this help\n",
+        prog, SAMPLE_RATE, FFT_SIZE, HOP_SIZE, BUFFER_FRAMES, UI_FPS, REALTIME_PRIORITY);
+}
+
+namespace {
+    const option long_options[] = {
+        {"backend",  required_argument, nullptr, 'b'},
+        {"input",    required_argument, nullptr, 'i'},
+        {"output",   required_argument, nullptr, 'o'},
+        {"headless", no_argument,       nullptr, 'H'},
+        {"channels", required_argument, nullptr, 'c'},
+        {"phase-lock", no_argument,     nullptr, 'L'},
+        {"pipeline", no_argument,       nullptr, 'D'},
+        {"period",   required_argument, nullptr, 'P'},
+        {"periods",  required_argument, nullptr, 'n'},
+        {"calibrate", no_argument,      nullptr, 'C'},
+        {"no-drift", no_argument,       nullptr, 'W'},
+        {"pitch",    required_argument, nullptr, 'p'},
+        {"engine",   required_argument, nullptr, 'E'},
+        {"rate",     required_argument, nullptr, 'r'},
+        {"fft-size", required_argument, nullptr, 'N'},
+        {"hop-size", required_argument, nullptr, 'k'},
+        {"block",    required_argument, nullptr, 'K'},
+        {"sample-format", required_argument, nullptr, 'S'},
+        {"seconds",  required_argument, nullptr, 's'},
+        {"fft-effort", required_argument, nullptr, 'e'},
+        {"wisdom-dir", required_argument, nullptr, 'w'},
+        {"batch",    required_argument, nullptr, 'B'},
+        {"output-dir", required_argument, nullptr, 'O'},
+        {"jobs",     required_argument, nullptr, 'j'},
+        {"metrics",  required_argument, nullptr, 'M'},
+        {"trace",    required_argument, nullptr, 'T'},
+        {"fps",      required_argument, nullptr, 'F'},
+        {"realtime", no_argument,       nullptr, 'R'},
+        {"rt-priority", required_argument, nullptr, 'Q'},
+        {"cpu",      required_argument, nullptr, 'A'},
+        {"config",   required_argument, nullptr, 'f'},
+        {"help",     no_argument,       nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}
+    };
+    const char* short_options = "b:i:o:Hc:LDP:n:CWp:E:r:N:k:K:S:s:e:w:B:O:j:M:T:F:RQ:A:f:h";
+
+    // One option, from the command line or a config file; false on a bad value
+    bool apply_option(int c, const char* arg, Options& opts, bool& output_set) {
+        switch (c) {
+            case 'b':
+                if (std::strcmp(arg, "alsa") == 0) {
+                    opts.backend = BackendType::ALSA;
+                } else if (std::strcmp(arg, "file") == 0) {
+                    opts.backend = BackendType::FILE;
+                } else if (std::strcmp(arg, "null") == 0) {
+                    opts.backend = BackendType::NULL_TONE;
+                } else {
+                    std::fprintf(stderr, "Unknown backend '%s'\n", arg);
+                    return false;
+                }
+                break;
+            case 'i':
+                opts.capture_device = arg;
+                break;
+            case 'o':
+                opts.playback_device = arg;
+                output_set = true;
+                break;
+            case 'H':
+                opts.headless = true;
+                break;
+            case 'c':
+                opts.channels = std::atoi(arg);
+                if (opts.channels < 1 || opts.channels > MAX_CHANNELS) {
+                    std::fprintf(stderr, "Channel count must be 1-%d\n", MAX_CHANNELS);
+                    return false;
+                }
+                break;
+            case 'L':
+                opts.phase_lock = true;
+                break;
+            case 'D':
+                opts.pipeline = true;
+                break;
+            case 'P':
+                opts.period_size = std::atoi(arg);
+                if (opts.period_size < 16) {
+                    std::fprintf(stderr, "Period size must be at least 16 frames\n");
+                    return false;
+                }
+                break;
+            case 'n':
+                opts.periods = std::atoi(arg);
+                if (opts.periods < 2) {
+                    std::fprintf(stderr, "Period count must be at least 2\n");
+                    return false;
+                }
+                break;
+            case 'C':
+                opts.calibrate = true;
+                break;
+            case 'W':
+                opts.drift_compensation = false;
+                break;
+            case 'p':
+                opts.pitch_ratio = std::strtof(arg, nullptr);
+                break;
+            case 'E':
+                if (!MultiChannelShifter::parse_engine(arg, opts.shift_engine)) {
+                    std::fprintf(stderr, "Unknown engine '%s'\n", arg);
+                    return false;
+                }
+                break;
+            case 'r':
+                opts.audio.sample_rate = std::atoi(arg);
+                if (opts.audio.sample_rate < MIN_SAMPLE_RATE || opts.audio.sample_rate > MAX_SAMPLE_RATE) {
+                    std::fprintf(stderr, "Sample rate must be %d-%d Hz\n", MIN_SAMPLE_RATE, MAX_SAMPLE_RATE);
+                    return false;
+                }
+                break;
+            case 'N':
+                opts.audio.fft_size = std::strtoul(arg, nullptr, 10);
+                if (opts.audio.fft_size < MIN_FFT_SIZE || opts.audio.fft_size > MAX_FFT_SIZE) {
+                    std::fprintf(stderr, "FFT size must be %zu-%zu\n", MIN_FFT_SIZE, MAX_FFT_SIZE);
+                    return false;
+                }
+                break;
+            case 'k':
+                opts.audio.hop_size = std::strtoul(arg, nullptr, 10);
+                if (opts.audio.hop_size < 16) {
+                    std::fprintf(stderr, "Hop size must be at least 16\n");
+                    return false;
+                }
+                break;
+            case 'K':
+                opts.audio.block_frames = std::atoi(arg);
+                if (opts.audio.block_frames < 16 || opts.audio.block_frames > MAX_BLOCK_FRAMES) {
+                    std::fprintf(stderr, "Block size must be 16-%d frames\n", MAX_BLOCK_FRAMES);
+                    return false;
+                }
+                break;
+            case 'S':
+                if (std::strcmp(arg, "auto") == 0) {
+                    opts.audio.sample_format = SampleFormat::AUTO;
+                } else if (std::strcmp(arg, "float") == 0) {
+                    opts.audio.sample_format = SampleFormat::FLOAT;
+                } else if (std::strcmp(arg, "s32") == 0) {
+                    opts.audio.sample_format = SampleFormat::S32;
+                } else if (std::strcmp(arg, "s24") == 0) {
+                    opts.audio.sample_format = SampleFormat::S24;
+                } else if (std::strcmp(arg, "s16") == 0) {
+                    opts.audio.sample_format = SampleFormat::S16;
+                } else {
+                    std::fprintf(stderr, "Unknown sample format '%s'\n", arg);
+                    return false;
+                }
+                break;
+            case 's':
+                opts.seconds = std::strtod(arg, nullptr);
+                break;
+            case 'e':
+                if (!FFTProcessor::parse_effort(arg, opts.fft_effort)) {
+                    std::fprintf(stderr, "Unknown FFT effort '%s'\n", arg);
+                    return false;
+                }
+                break;
+            case 'w':
+                opts.wisdom_dir = arg;
+                break;
+            case 'B':
+                opts.batch_inputs.push_back(arg);
+                break;
+            case 'O':
+                opts.output_dir = arg;
+                break;
+            case 'j':
+                opts.jobs = std::atoi(arg);
+                if (opts.jobs < 0) {
+                    std::fprintf(stderr, "Job count must be >= 0\n");
+                    return false;
+                }
+                break;
+            case 'M':
+                opts.metrics_target = arg;
+                break;
+            case 'T':
+                opts.trace_dir = arg;
+                break;
+            case 'F':
+                opts.ui_fps = std::atoi(arg);
+                if (opts.ui_fps < 1 || opts.ui_fps > 240) {
+                    std::fprintf(stderr, "FPS must be 1-240\n");
+                    return false;
+                }
+                break;
+            case 'R':
+                opts.realtime.enabled = true;
+                break;
+            case 'Q':
+                opts.realtime.enabled = true;
+                opts.realtime.priority = std::atoi(arg);
+                if (opts.realtime.priority < 1 || opts.realtime.priority > 99) {
+                    std::fprintf(stderr, "Real-time priority must be 1-99\n");
+                    return false;
+                }
+                break;
+            case 'A':
+                opts.realtime.enabled = true;
+                opts.realtime.cpu = std::atoi(arg);
+                if (opts.realtime.cpu < 0) {
+                    std::fprintf(stderr, "CPU must be >= 0\n");
+                    return false;
+                }
+                break;
+            default:
+                return false;
+        }
+        return true;
+    }
+
+    std::string trim(const std::string& text) {
+        size_t begin = text.find_first_not_of(" \t\r");
+        if (begin == std::string::npos) return "";
+        size_t end = text.find_last_not_of(" \t\r");
+        return text.substr(begin, end - begin + 1);
+    }
+
+    // "name = value" lines using the long option names; '#' starts a comment.
+    // Flags take no value, or "true"/"false".
+    bool load_config_file(const std::string& path, Options& opts, bool& output_set) {
+        std::ifstream file(path);
+        if (!file) {
+            std::fprintf(stderr, "Cannot read config file '%s'\n", path.c_str());
+            return false;
+        }
+
+        std::string line;
+        for (int number = 1; std::getline(file, line); number++) {
+            line = trim(line.substr(0, line.find('#')));
+            if (line.empty()) continue;
+
+            size_t equals = line.find('=');
+            std::string name = trim(line.substr(0, equals));
+            std::string value = equals == std::string::npos ? "" : trim(line.substr(equals + 1));
+
+            const option* found = nullptr;
+            for (const option* o = long_options; o->name; o++) {
+                if (name == o->name && o->val != 'f' && o->val != 'h') found = o;
+            }
+            if (!found) {
+                std::fprintf(stderr, "%s:%d: unknown option '%s'\n", path.c_str(), number, name.c_str());
+                return false;
+            }
+            if (found->has_arg == no_argument) {
+                if (value == "false") continue;
+                if (!value.empty() && value != "true") {
+                    std::fprintf(stderr, "%s:%d: '%s' takes true or false\n", path.c_str(), number, name.c_str());
+                    return false;
+                }
+            } else if (value.empty()) {
+                std::fprintf(stderr, "%s:%d: '%s' needs a value\n", path.c_str(), number, name.c_str());
+                return false;
+            }
+            if (!apply_option(found->val, value.c_str(), opts, output_set)) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+bool parse_options(int argc, char** argv, Options& opts) {
+    bool output_set = false;
+    int c;
+
+    // The config file first, so the command line overrides it
+    opterr = 0;
+    while ((c = getopt_long(argc, argv, short_options, long_options, nullptr)) != -1) {
+        if (c == 'f' && !load_config_file(optarg, opts, output_set)) {
+            return false;
+        }
+    }
+    opterr = 1;
+    optind = 0;
+
+    while ((c = getopt_long(argc, argv, short_options, long_options, nullptr)) != -1) {
+        if (c == 'f') continue;
+        if (c == 'h' || c == '?') {
+            print_usage(argv[0]);
+            return false;
+        }
+        if (!apply_option(c, optarg, opts, output_set)) {
+            return false;
+        }
+    }
+
+    for (int i = optind; i < argc; i++) {
+        opts.batch_inputs.push_back(argv[i]);
+    }
+    if (!opts.output_dir.empty() && opts.batch_inputs.empty()) {
+        std::fprintf(stderr, "--output-dir needs batch inputs\n");
+        return false;
+    }
+
+    if (opts.backend != BackendType::ALSA) {
+        opts.headless = true;
+        if (!output_set) {
+            opts.playback_device.clear();
+        }
+    }
+
+    // The squared Hann windows only overlap-add to a constant when the hop
+    // divides the FFT size with at least 4x overlap
+    if (opts.audio.fft_size % opts.audio.hop_size != 0 || opts.audio.fft_size / opts.audio.hop_size < 4) {
+        std::fprintf(stderr, "Hop size must divide the FFT size (%zu) and be at most a quarter of it\n",
+                     opts.audio.fft_size);
+        return false;
+    }
+
+    if (opts.calibrate && opts.backend != BackendType::ALSA) {
+        std::fprintf(stderr, "--calibrate needs the ALSA backend\n");
+        return false;
+    }
+
+    if (opts.backend == BackendType::FILE && opts.capture_device == "default") {
+        std::fprintf(stderr, "The file backend needs --input <file.wav>\n");
+        return false;
+    }
+
+    return true;
+}
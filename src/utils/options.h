@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "audio/params.h"
+#include "dsp/fft.h"
+#include "dsp/shifter.h"
+#include "utils/realtime.h"
+#include "config.h"
+
+enum class BackendType {
+    ALSA,
+    FILE,
+    NULL_TONE
+};
+
+struct Options {
+    BackendType backend = BackendType::ALSA;
+    bool headless = false;
+    std::string capture_device = "default";   // ALSA PCM or input WAV path
+    std::string playback_device = "default";  // ALSA PCM or output WAV path
+    int channels = 1;
+    int period_size = 0;                      // ALSA period in frames, 0 = calibrated or driver default
+    int periods = 0;                          // ALSA periods per buffer, 0 = driver default
+    bool calibrate = false;                   // find the lowest stable period and cache it
+    bool drift_compensation = true;           // resample playback when the streams cannot be linked
+    bool phase_lock = false;                  // lock channel phases to channel 0
+    bool pipeline = false;                    // STFT analysis and synthesis on separate threads
+    float pitch_ratio = 1.0f;
+    ShiftEngine shift_engine = ShiftEngine::STFT;
+    AudioParams audio;                        // sample rate, FFT, hop and block sizes
+    double seconds = 10.0;                    // length of the null-backend tone
+    FFTPlanEffort fft_effort = FFTPlanEffort::MEASURE;
+    std::string wisdom_dir = FFTProcessor::default_wisdom_dir();
+    std::vector<std::string> batch_inputs;    // batch mode when non-empty
+    std::string output_dir;                   // batch outputs
+    int jobs = 0;                             // batch threads, 0 = one per core
+    std::string metrics_target;               // "unix:/path" socket or a file, empty = off
+    std::string trace_dir;                    // Chrome trace dumps, empty = off
+    int ui_fps = UI_FPS;                      // TUI redraw cap
+    RealtimeConfig realtime;                  // SCHED_FIFO, pinning, mlockall, FTZ/DAZ
+};
+
+// Returns false if the program should exit (bad arguments or --help)
+bool parse_options(int argc, char** argv, Options& opts);
+void print_usage(const char* prog);
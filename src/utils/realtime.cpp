@@ -0,0 +1,136 @@
+#include "utils/realtime.h"
+#include "utils/logger.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+namespace {
+    std::string refused(const char* what, int error) {
+        return std::string(what) + " refused: " + std::strerror(error);
+    }
+}
+
+int Realtime::lock_memory() {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        int error = errno;
+        LOG_ERRORF("mlockall failed: %s (raise RLIMIT_MEMLOCK, e.g. ulimit -l)", std::strerror(error));
+        return error;
+    }
+    return 0;
+}
+
+int Realtime::set_fifo(int priority) {
+    sched_param param{};
+    param.sched_priority = priority;
+    int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (error != 0) {
+        LOG_ERRORF("SCHED_FIFO %d refused: %s (needs CAP_SYS_NICE or an rtprio limit), "
+                   "staying time-shared", priority, std::strerror(error));
+    }
+    return error;
+}
+
+int Realtime::pin(int cpu) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) return EINVAL;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (error != 0) {
+        LOG_ERRORF("Cannot pin to CPU %d: %s", cpu, std::strerror(error));
+    }
+    return error;
+}
+
+bool Realtime::disable_denormals() {
+#if defined(__SSE__)
+    // FTZ (bit 15) and DAZ (bit 6) of MXCSR
+    _mm_setcsr(_mm_getcsr() | 0x8040);
+    return true;
+#elif defined(__aarch64__)
+    uint64_t fpcr;
+    asm volatile("mrs %0, fpcr" : "=r"(fpcr));
+    asm volatile("msr fpcr, %0" : : "r"(fpcr | (1ull << 24)));
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Realtime::prefault_stack() {
+    volatile unsigned char stack[REALTIME_STACK_PREFAULT];
+    for (size_t i = 0; i < sizeof(stack); i += 4096) {
+        stack[i] = 0;
+    }
+}
+
+void Realtime::enter_audio_thread(const RealtimeConfig& config, RealtimeReport& report) {
+    report.priority = config.priority;
+    report.fifo_error = set_fifo(config.priority);
+    report.cpu = config.cpu;
+    if (config.cpu >= 0) {
+        report.pin_error = pin(config.cpu);
+    }
+    report.denormals_off = disable_denormals();
+    prefault_stack();
+}
+
+std::string Realtime::describe(const RealtimeReport& report) {
+    if (!report.requested) return "Real-time mode: off\n";
+
+    char line[160];
+    std::string text = "Real-time mode:\n";
+
+    if (report.fifo_error == 0) {
+        std::snprintf(line, sizeof(line), "  scheduling: SCHED_FIFO priority %d", report.priority);
+        text += line;
+        if (report.workers_fifo_error != 0) text += " (DSP workers: " + refused("FIFO", report.workers_fifo_error) + ")";
+    } else {
+        text += "  scheduling: time-shared (" + refused("SCHED_FIFO", report.fifo_error) + ")";
+    }
+    text += "\n";
+
+    if (report.cpu < 0) {
+        text += "  CPU: not pinned\n";
+    } else if (report.pin_error == 0) {
+        std::snprintf(line, sizeof(line), "  CPU: audio thread pinned to core %d\n", report.cpu);
+        text += line;
+    } else {
+        std::snprintf(line, sizeof(line), "  CPU: not pinned to core %d (", report.cpu);
+        text += line + refused("pinning", report.pin_error) + ")\n";
+    }
+
+    std::snprintf(line, sizeof(line), "%.1f MiB of DSP buffers prefaulted", report.prefaulted_bytes / 1048576.0);
+    if (report.memory_error == 0) {
+        text += std::string("  memory: locked, ") + line + "\n";
+    } else {
+        text += "  memory: not locked (" + refused("mlockall", report.memory_error) + "), " + line + "\n";
+    }
+
+    text += report.denormals_off ? "  denormals: flushed to zero (FTZ/DAZ)\n"
+                                 : "  denormals: no flush-to-zero mode on this CPU\n";
+    return text;
+}
+
+std::string Realtime::summary(const RealtimeReport& report) {
+    if (!report.requested) return "";
+
+    char text[128];
+    std::snprintf(text, sizeof(text), "RT: %s%s, %s, %s",
+                  report.fifo_error == 0 ? "FIFO " : "time-shared",
+                  report.fifo_error == 0 ? std::to_string(report.priority).c_str() : "",
+                  report.memory_error == 0 ? "locked" : "not locked",
+                  report.denormals_off ? "FTZ" : "no FTZ");
+    std::string line = text;
+    if (report.cpu >= 0) {
+        line += report.pin_error == 0 ? ", core " + std::to_string(report.cpu) : ", not pinned";
+    }
+    return line;
+}
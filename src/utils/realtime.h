@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include "config.h"
+
+// Opt-in real-time mode (--realtime). Everything here degrades cleanly:
+// a refused request is logged and recorded in the report, and the program
+// carries on as an ordinary time-shared process.
+struct RealtimeConfig {
+    bool enabled = false;
+    int priority = REALTIME_PRIORITY;  // SCHED_FIFO priority, 1-99
+    int cpu = -1;                      // core to pin the audio thread to, -1 = any
+};
+
+// What was actually obtained; errors are errno values, 0 = granted
+struct RealtimeReport {
+    bool requested = false;
+    int memory_error = -1;        // mlockall
+    size_t prefaulted_bytes = 0;  // DSP buffers touched up front
+    int fifo_error = -1;          // SCHED_FIFO for the audio thread
+    int priority = 0;
+    int workers_fifo_error = 0;   // first refusal among DSP workers
+    int cpu = -1;
+    int pin_error = -1;
+    bool denormals_off = false;   // FTZ/DAZ on the audio thread
+};
+
+class Realtime {
+public:
+    // mlockall(MCL_CURRENT | MCL_FUTURE); returns 0 or errno
+    static int lock_memory();
+
+    // Calling thread: SCHED_FIFO at priority; returns 0 or errno
+    static int set_fifo(int priority);
+    // Calling thread: run only on cpu; returns 0 or errno
+    static int pin(int cpu);
+    // Calling thread: flush denormal results and inputs to zero (FTZ/DAZ on
+    // x86, FZ on AArch64); false where the CPU has no such mode
+    static bool disable_denormals();
+    // Touch REALTIME_STACK_PREFAULT bytes of the calling thread's stack
+    static void prefault_stack();
+
+    // All of the per-thread steps for the audio thread, recorded in report
+    static void enter_audio_thread(const RealtimeConfig& config, RealtimeReport& report);
+
+    // One line per guarantee, for the start-up report
+    static std::string describe(const RealtimeReport& report);
+    // The same on one short line, for the TUI
+    static std::string summary(const RealtimeReport& report);
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cerrno>
+#include <semaphore.h>
+
+// Counting semaphore for waking a helper thread from the audio thread.
+// post() never blocks: it is one atomic increment, plus a futex wake only
+// when the other side is asleep. A condition variable would make the poster
+// take the sleeper's mutex.
+class Semaphore {
+public:
+    Semaphore() { sem_init(&sem_, 0, 0); }
+    ~Semaphore() { sem_destroy(&sem_); }
+
+    Semaphore(const Semaphore&) = delete;
+    Semaphore& operator=(const Semaphore&) = delete;
+
+    void post() { sem_post(&sem_); }
+
+    void wait() {
+        while (sem_wait(&sem_) != 0 && errno == EINTR) {}
+    }
+
+    // Drop posts nobody waited for; only while no thread is waiting
+    void clear() {
+        while (sem_trywait(&sem_) == 0) {}
+    }
+
+private:
+    sem_t sem_;
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded lock-free single-producer/single-consumer queue.
+// Slots are preallocated from a prototype value and reused, so elements
+// that own memory (e.g. std::vector) are written in place without
+// allocating once the queue is constructed.
+template <typename T>
+class SPSCQueue {
+public:
+    explicit SPSCQueue(size_t capacity, const T& prototype = T())
+        : mask_(round_up_pow2(capacity) - 1), slots_(mask_ + 1, prototype),
+          head_(0), tail_(0) {
+    }
+
+    SPSCQueue(const SPSCQueue&) = delete;
+    SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+    // Producer: slot to fill in place, or nullptr when full
+    T* begin_write() {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) > mask_) {
+            return nullptr;
+        }
+        return &slots_[tail & mask_];
+    }
+
+    void commit_write() {
+        tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool try_push(const T& value) {
+        T* slot = begin_write();
+        if (!slot) return false;
+        *slot = value;
+        commit_write();
+        return true;
+    }
+
+    // Consumer: oldest element, or nullptr when empty
+    T* front() {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &slots_[head & mask_];
+    }
+
+    void pop() {
+        head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool try_pop(T& value) {
+        T* slot = front();
+        if (!slot) return false;
+        value = *slot;
+        pop();
+        return true;
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+private:
+    static size_t round_up_pow2(size_t n) {
+        size_t p = 1;
+        while (p < n) p <<= 1;
+        return p;
+    }
+
+    const size_t mask_;
+    std::vector<T> slots_;
+    alignas(64) std::atomic<size_t> head_;
+    alignas(64) std::atomic<size_t> tail_;
+};
@@ -0,0 +1,93 @@
+#include "utils/thread_pool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threads)
+    : next_queue_(0), queued_(0), unfinished_(0), stopping_(false) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0; i < threads; i++) {
+        queues_.push_back(std::make_unique<WorkQueue>());
+    }
+    for (size_t i = 0; i < threads; i++) {
+        threads_.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    work_available_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+// Counted before the push: a worker could otherwise take and finish the
+// task first and decrement both counters below zero. A worker that sees
+// the count before the task lands just retries take().
+void ThreadPool::submit(std::function<void()> task) {
+    WorkQueue& queue = *queues_[next_queue_];
+    next_queue_ = (next_queue_ + 1) % queues_.size();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        unfinished_++;
+        queued_.fetch_add(1, std::memory_order_release);
+    }
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    work_available_.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    all_done_.wait(lock, [&] { return unfinished_ == 0; });
+}
+
+// Own deque from the front, so tasks run in submission order; others from
+// the back, so a thief takes the task its owner would reach last
+bool ThreadPool::take(size_t self, std::function<void()>& task) {
+    for (size_t i = 0; i < queues_.size(); i++) {
+        WorkQueue& queue = *queues_[(self + i) % queues_.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) continue;
+
+        if (i == 0) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        } else {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        queued_.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::worker_loop(size_t self) {
+    std::function<void()> task;
+    for (;;) {
+        if (take(self, task)) {
+            task();
+            task = nullptr;
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--unfinished_ == 0) {
+                all_done_.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        work_available_.wait(lock, [&] {
+            return stopping_ || queued_.load(std::memory_order_acquire) > 0;
+        });
+        if (stopping_ && queued_.load(std::memory_order_acquire) == 0) return;
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool for coarse jobs (one file, one render...).
+// Every worker owns a deque: it takes its own tasks oldest first, in the
+// order they were submitted, and when that runs dry it steals the newest
+// task from another worker. Submission order is therefore kept (largest jobs
+// first, say), and uneven job lengths still keep every core busy until the
+// pool drains.
+class ThreadPool {
+public:
+    // threads == 0 means one worker per core
+    explicit ThreadPool(size_t threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Tasks are dealt round-robin over the worker deques
+    void submit(std::function<void()> task);
+
+    // Blocks until every submitted task has finished
+    void wait();
+
+    size_t size() const { return threads_.size(); }
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool take(size_t self, std::function<void()>& task);
+    void worker_loop(size_t self);
+
+    std::vector<std::unique_ptr<WorkQueue>> queues_;
+    std::vector<std::thread> threads_;
+    size_t next_queue_;
+
+    // Sleep/wake and completion tracking
+    std::mutex mutex_;
+    std::condition_variable work_available_;
+    std::condition_variable all_done_;
+    std::atomic<size_t> queued_;
+    size_t unfinished_;
+    bool stopping_;
+};
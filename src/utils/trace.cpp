@@ -0,0 +1,158 @@
+#include "utils/trace.h"
+#include "utils/logger.h"
+#include "config.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+thread_local Tracer::ThreadBuffer* Tracer::current_ = nullptr;
+
+Tracer& Tracer::instance() {
+    static Tracer tracer;
+    return tracer;
+}
+
+Tracer::Tracer() : pending_(nullptr), last_dump_ns_(0), running_(false) {
+}
+
+Tracer::~Tracer() {
+    stop();
+}
+
+bool Tracer::start(const std::string& dir) {
+    if (!compiled_in()) {
+        LOG_ERROR("Tracing is not compiled in, rebuild with -DVOCODER_TRACE=ON");
+        return false;
+    }
+    dir_ = dir;
+    running_ = true;
+    thread_ = std::thread(&Tracer::dump_loop, this);
+    LOG_INFO("Tracing: dumps go to " + dir_ + " (SIGUSR1 or xrun)");
+    return true;
+}
+
+void Tracer::stop() {
+    running_ = false;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+Tracer::ThreadBuffer& Tracer::buffer() {
+    if (!current_) register_thread("thread");
+    return *current_;
+}
+
+void Tracer::register_thread(const char* name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (current_) {
+        current_->name = name;
+        return;
+    }
+    auto buffer = std::make_unique<ThreadBuffer>();
+    buffer->name = name;
+    buffer->tid = static_cast<long>(syscall(SYS_gettid));
+    buffer->events.reset(new Event[TRACE_RING_EVENTS]);
+    current_ = buffer.get();
+    buffers_.push_back(std::move(buffer));
+}
+
+void Tracer::push(const Event& event) {
+    ThreadBuffer& b = buffer();
+    uint64_t head = b.head.load(std::memory_order_relaxed);
+    b.events[head % TRACE_RING_EVENTS] = event;
+    b.head.store(head + 1, std::memory_order_release);
+}
+
+void Tracer::record(const char* name, uint64_t start_ns, uint64_t end_ns) {
+    push(Event{name, start_ns, end_ns - start_ns, false});
+}
+
+void Tracer::instant(const char* name) {
+    push(Event{name, now_ns(), 0, true});
+}
+
+void Tracer::request_dump(const char* reason) {
+    const char* expected = nullptr;
+    pending_.compare_exchange_strong(expected, reason, std::memory_order_release, std::memory_order_relaxed);
+}
+
+void Tracer::dump_loop() {
+    const uint64_t holdoff_ns = static_cast<uint64_t>(TRACE_DUMP_HOLDOFF_SECONDS * 1e9);
+    while (running_) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(TRACE_POLL_MS));
+
+        const char* reason = pending_.exchange(nullptr, std::memory_order_acquire);
+        if (!reason) continue;
+        uint64_t now = now_ns();
+        if (last_dump_ns_ != 0 && now - last_dump_ns_ < holdoff_ns) continue;
+        last_dump_ns_ = now;
+        dump(reason);
+    }
+}
+
+// Readers copy a ring while its thread keeps writing: events older than
+// head - TRACE_RING_EVENTS after the copy may have been overwritten and are
+// dropped.
+bool Tracer::dump(const char* reason) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const uint64_t now = now_ns();
+    const uint64_t since = now - std::min<uint64_t>(now, static_cast<uint64_t>(TRACE_DUMP_SECONDS * 1e9));
+
+    char stamp[32];
+    time_t wall = time(nullptr);
+    tm local;
+    localtime_r(&wall, &local);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+    std::string path = dir_ + "/trace-" + stamp + "-" + reason + ".json";
+
+    FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        LOG_ERROR("Cannot write trace " + path);
+        return false;
+    }
+
+    long pid = static_cast<long>(getpid());
+    std::fprintf(file, "{\"traceEvents\":[\n");
+    bool first = true;
+    std::vector<Event> events(TRACE_RING_EVENTS);
+    size_t written = 0;
+
+    for (const auto& b : buffers_) {
+        std::fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%ld,"
+                     "\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n", pid, b->tid, b->name.c_str());
+        first = false;
+
+        uint64_t head = b->head.load(std::memory_order_acquire);
+        uint64_t begin = head > TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS : 0;
+        for (uint64_t i = begin; i < head; i++) {
+            events[i - begin] = b->events[i % TRACE_RING_EVENTS];
+        }
+        uint64_t after = b->head.load(std::memory_order_acquire);
+        uint64_t valid = after >= TRACE_RING_EVENTS ? after - TRACE_RING_EVENTS + 1 : 0;
+
+        for (uint64_t i = std::max(begin, valid); i < head; i++) {
+            const Event& e = events[i - begin];
+            if (e.start_ns < since) continue;
+            if (e.instant) {
+                std::fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%.3f,\"pid\":%ld,\"tid\":%ld}",
+                             e.name, e.start_ns / 1e3, pid, b->tid);
+            } else {
+                std::fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%ld,\"tid\":%ld}",
+                             e.name, e.start_ns / 1e3, e.dur_ns / 1e3, pid, b->tid);
+            }
+            written++;
+        }
+    }
+    std::fprintf(file, "\n]}\n");
+
+    if (std::fclose(file) != 0) {
+        LOG_ERROR("Cannot write trace " + path);
+        return false;
+    }
+    LOG_INFOF("Trace (%s): %zu events written to %s", reason, written, path.c_str());
+    return true;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Per-block pipeline tracing in Chrome trace format (chrome://tracing, Perfetto).
+// TRACE_SCOPE("name") records the duration of the enclosing scope into a
+// preallocated ring of TRACE_RING_EVENTS per thread; recording is two clock
+// reads and a store, never locks and only allocates on a thread's first event
+// (or at TRACE_THREAD). The last TRACE_DUMP_SECONDS of every thread are
+// written to a JSON file on request_dump(), which is async-signal-safe and
+// cheap enough to call on an xrun.
+//
+// The macros compile to nothing unless the build defines VOCODER_TRACE
+// (cmake -DVOCODER_TRACE=ON); the Tracer class is always there so callers
+// need no #ifdefs.
+class Tracer {
+public:
+    static Tracer& instance();
+
+    static constexpr bool compiled_in() {
+#ifdef VOCODER_TRACE
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Start the dump thread writing trace-<time>-<reason>.json into dir
+    bool start(const std::string& dir);
+    void stop();
+
+    // Names the calling thread in the trace and preallocates its ring
+    void register_thread(const char* name);
+
+    void record(const char* name, uint64_t start_ns, uint64_t end_ns);
+    void instant(const char* name);
+
+    // Async-signal-safe; reason must be a string literal. Requests closer
+    // than TRACE_DUMP_HOLDOFF_SECONDS to the previous dump are ignored.
+    void request_dump(const char* reason);
+
+    static uint64_t now_ns() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+    }
+
+private:
+    struct Event {
+        const char* name;
+        uint64_t start_ns;
+        uint64_t dur_ns;
+        bool instant;
+    };
+
+    struct ThreadBuffer {
+        std::string name;
+        long tid;
+        std::unique_ptr<Event[]> events;  // TRACE_RING_EVENTS
+        std::atomic<uint64_t> head{0};    // events ever written
+    };
+
+    Tracer();
+    ~Tracer();
+
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    ThreadBuffer& buffer();
+    void push(const Event& event);
+    void dump_loop();
+    bool dump(const char* reason);
+
+    std::mutex mutex_;                              // buffers_ registration and dumps
+    std::deque<std::unique_ptr<ThreadBuffer>> buffers_;  // never freed, threads may exit
+    std::atomic<const char*> pending_;              // requested dump reason
+    uint64_t last_dump_ns_;
+    std::string dir_;
+    std::atomic<bool> running_;
+    std::thread thread_;
+
+    static thread_local ThreadBuffer* current_;
+};
+
+class TraceScope {
+public:
+    explicit TraceScope(const char* name) : name_(name), start_ns_(Tracer::now_ns()) {}
+    ~TraceScope() { Tracer::instance().record(name_, start_ns_, Tracer::now_ns()); }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name_;
+    uint64_t start_ns_;
+};
+
+#ifdef VOCODER_TRACE
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_INSTANT(name) Tracer::instance().instant(name)
+#define TRACE_THREAD(name) Tracer::instance().register_thread(name)
+#else
+#define TRACE_SCOPE(name) do {} while (0)
+#define TRACE_INSTANT(name) do {} while (0)
+#define TRACE_THREAD(name) do {} while (0)
+#endif